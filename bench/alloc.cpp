@@ -0,0 +1,111 @@
+/**
+ * times NEWMEM_ARR/DELMEM_ARR from 1, 2, 4... threads up to the argument
+ * (default: twice the cores). most blocks are small, some are big, and a
+ * quarter of the frees are of blocks another thread allocated.
+ * cd bench && g++ -std=c++11 -O2 -pthread -I.. alloc.cpp ../mem.cpp -o alloc && ./alloc
+ * mem.h picks what is timed: as it ships, the debug heap takes its lock on
+ * every call. comment out USE_CUSTOM_MEMORY_MANAGEMENT_DEBUG to time the
+ * per-thread caches, or USE_CUSTOM_MEMORY_MANAGEMENT (and leave ../mem.cpp
+ * off the command) to time the system allocator.
+ */
+#include "bench.h"
+
+#include <atomic>
+#include <stdlib.h>	// atoi
+#include <thread>
+
+/** blocks each thread keeps at once */
+static const int SLOTS = 2048;
+/** operations done by each thread */
+static const int OPERATIONS = 1 << 19;
+/** most blocks are smaller than this */
+static const int SMALL_SIZE = 256;
+/** the most threads timed */
+static const int MOST_THREADS = 64;
+
+/** blocks handed to each thread for it to free */
+static std::atomic<char*> s_handoff[MOST_THREADS][256];
+
+/** frees a block handed over to thread a_thread, if there is one in a_slot */
+inline void freeHandoff(const int a_thread, const int a_slot)
+{
+	char * block = s_handoff[a_thread][a_slot].exchange(0);
+	if(block)
+		DELMEM_ARR(block);
+}
+
+/** allocates or frees a random slot's block OPERATIONS times */
+void churn(const int a_thread, const int a_threads)
+{
+	char * blocks[SLOTS] = {0};
+	BenchRandom random(0x9e3779b97f4a7c15ull * (a_thread+1));
+	for(int i = 0; i < OPERATIONS; ++i)
+	{
+		unsigned long long r = random.next();
+		const int slot = (int)(r % SLOTS);
+		if(blocks[slot])
+		{
+			// a quarter of the blocks are freed by the next thread
+			if(((r >> 32) & 3) == 0)
+			{
+				char * old = s_handoff[(a_thread+1) % a_threads][slot & 255].exchange(blocks[slot]);
+				if(old)
+					DELMEM_ARR(old);
+			}
+			else
+			{
+				DELMEM_ARR(blocks[slot]);
+			}
+			blocks[slot] = 0;
+		}
+		else
+		{
+			// one block in 8 is up to 20 times bigger
+			const int size = 1 + (int)((r >> 40) % (((r >> 34) & 7) ? SMALL_SIZE : SMALL_SIZE*20));
+			blocks[slot] = NEWMEM_ARR(char, size);
+			blocks[slot][0] = (char)i;
+		}
+		if((i & 63) == 0)
+			freeHandoff(a_thread, (i >> 6) & 255);
+	}
+	for(int slot = 0; slot < SLOTS; ++slot)
+	{
+		if(blocks[slot])
+			DELMEM_ARR(blocks[slot]);
+	}
+}
+
+int main(int argc, char ** argv)
+{
+	benchInit();
+	int maxThreads = (argc > 1) ? atoi(argv[1]) : 2*(int)std::thread::hardware_concurrency();
+	if(maxThreads < 1)
+		maxThreads = 1;
+	if(maxThreads > MOST_THREADS)
+		maxThreads = MOST_THREADS;
+	printf("%d cores, %d operations per thread\n", (int)std::thread::hardware_concurrency(), OPERATIONS);
+	printf("%8s %10s %14s\n", "threads", "best ms", "Mops/s");
+	for(int threads = 1; threads <= maxThreads; threads *= 2)
+	{
+		std::thread * workers = new std::thread[threads];
+		double ms = benchBest(3, [&]()
+		{
+			for(int t = 0; t < threads; ++t)
+			{
+				workers[t] = std::thread(churn, t, threads);
+			}
+			for(int t = 0; t < threads; ++t)
+			{
+				workers[t].join();
+			}
+			for(int t = 0; t < threads; ++t)
+			{
+				for(int slot = 0; slot < 256; ++slot)
+					freeHandoff(t, slot);
+			}
+		});
+		delete [] workers;
+		printf("%8d %10.2f %14.2f\n", threads, ms, (double)threads * OPERATIONS / (ms * 1000));
+	}
+	return 0;
+}
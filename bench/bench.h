@@ -0,0 +1,85 @@
+#pragma once
+
+#include "../license.txt"
+#include "../mem.h"
+
+#include <chrono>
+#include <stdio.h>
+
+/**
+ * shared by the programs in bench/, which time the containers on a workload
+ * each. every program is one file, built with the one line of g++ in its
+ * header comment, from the bench directory. timings are the best of a few
+ * runs, so they are the cost of the code rather than of whatever else the
+ * machine was doing.
+ * the custom memory manager's checks would be most of the time measured,
+ * so benchInit turns them off. mem.h's debug configuration also defines
+ * _GLIBCXX_DEBUG, which has std algorithms check their input (a
+ * std::lower_bound checks the whole range), so std:: is not timed here.
+ */
+
+/** turns off the memory manager's checks. call first */
+inline void benchInit()
+{
+	MEM::setDebugLevel(MEM::DEBUG_OFF);
+}
+
+/** @return seconds since some fixed moment */
+inline double benchSeconds()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * calls a_work() a_runs times
+ * @return milliseconds taken by the fastest call
+ */
+template<typename WORK>
+double benchBest(const int a_runs, WORK a_work)
+{
+	double best = 0;
+	for(int i = 0; i < a_runs; ++i)
+	{
+		double start = benchSeconds();
+		a_work();
+		double ms = (benchSeconds() - start) * 1000;
+		if(i == 0 || ms < best)
+			best = ms;
+	}
+	return best;
+}
+
+/**
+ * calls a_setup() then a_work() a_runs times, timing only a_work, so
+ * a_setup can put back input that a_work changes
+ * @return milliseconds taken by the fastest call of a_work
+ */
+template<typename SETUP, typename WORK>
+double benchBest(const int a_runs, SETUP a_setup, WORK a_work)
+{
+	double best = 0;
+	for(int i = 0; i < a_runs; ++i)
+	{
+		a_setup();
+		double start = benchSeconds();
+		a_work();
+		double ms = (benchSeconds() - start) * 1000;
+		if(i == 0 || ms < best)
+			best = ms;
+	}
+	return best;
+}
+
+/** xorshift64: the same numbers every run, without the cost of rand() */
+struct BenchRandom
+{
+	unsigned long long state;
+	BenchRandom(const unsigned long long a_seed = 0x9e3779b97f4a7c15ull):state(a_seed){}
+	inline unsigned long long next()
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return state;
+	}
+};
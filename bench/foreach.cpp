@@ -0,0 +1,75 @@
+/**
+ * times walking a container: by index, by iterator, by for_each with a
+ * lambda, and by for_each through a std::function, which is how for_each
+ * took its callable before it became a template
+ * cd bench && g++ -std=c++11 -O2 -pthread -I.. foreach.cpp ../mem.cpp -o foreach && ./foreach
+ */
+#include "bench.h"
+#include "templatevector.h"
+#include "templatevectorlist.h"
+
+#include <functional>
+
+/** elements in each container */
+static const int COUNT = 10000000;
+
+/** times a_walk summing the container into a_sum, and prints it */
+template<typename WALK>
+void timeWalk(const char * a_name, long long const & a_sum, WALK a_walk)
+{
+	double ms = benchBest(5, a_walk);
+	printf("%-44s %8.2f ms  (sum %lld)\n", a_name, ms, a_sum);
+}
+
+int main()
+{
+	benchInit();
+	TemplateVector<int> vector;
+	TemplateVectorList<int> list(4096);
+	vector.setSize(COUNT);
+	for(int i = 0; i < COUNT; ++i)
+	{
+		vector[i] = i & 0xffff;
+		list.add(i & 0xffff);
+	}
+	long long sum = 0;
+	std::function<void(int&)> addToSum = [&](int & a_value){ sum += a_value; };
+
+	timeWalk("TemplateVector get(i)", sum, [&](){
+		sum = 0;
+		for(int i = 0; i < vector.size(); ++i)
+			sum += vector.get(i);
+	});
+	timeWalk("TemplateVector range-for", sum, [&](){
+		sum = 0;
+		for(int value : vector)
+			sum += value;
+	});
+	timeWalk("TemplateVector for_each(lambda)", sum, [&](){
+		sum = 0;
+		vector.for_each([&](int & a_value){ sum += a_value; });
+	});
+	timeWalk("TemplateVector for_each(std::function)", sum, [&](){
+		sum = 0;
+		vector.for_each(addToSum);
+	});
+	timeWalk("TemplateVectorList get(i)", sum, [&](){
+		sum = 0;
+		for(int i = 0; i < list.size(); ++i)
+			sum += list.get(i);
+	});
+	timeWalk("TemplateVectorList range-for", sum, [&](){
+		sum = 0;
+		for(int value : list)
+			sum += value;
+	});
+	timeWalk("TemplateVectorList for_each(lambda)", sum, [&](){
+		sum = 0;
+		list.for_each([&](int & a_value){ sum += a_value; });
+	});
+	timeWalk("TemplateVectorList for_each(std::function)", sum, [&](){
+		sum = 0;
+		list.for_each(addToSum);
+	});
+	return 0;
+}
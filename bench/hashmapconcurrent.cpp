@@ -0,0 +1,97 @@
+/**
+ * times TemplateHashMapConcurrent under a mix of reads and writes (90/10 and
+ * 50/50) from 1, 2, 4... threads up to the argument (default: twice the
+ * cores). a one-shard map, which is one TemplateHashMap behind one lock,
+ * is timed alongside it.
+ * cd bench && g++ -std=c++11 -O2 -pthread -I.. hashmapconcurrent.cpp ../mem.cpp -o hashmapconcurrent && ./hashmapconcurrent
+ */
+#include "bench.h"
+#include "templatehashmapconcurrent.h"
+
+#include <stdlib.h>	// atoi
+#include <thread>
+
+/** keys are drawn from [0, KEYS). half of them are in the map at the start */
+static const int KEYS = 1 << 20;
+/** operations done by each thread */
+static const int OPERATIONS = 1 << 21;
+
+/**
+ * a_threads threads each do OPERATIONS random operations on a_map: a read
+ * a_readPercent of the time, otherwise a set or an erase, equally often,
+ * so the map stays about the same size
+ * @return millions of operations per second, over all threads
+ */
+template<typename MAP>
+double throughput(MAP & a_map, const int a_threads, const int a_readPercent)
+{
+	std::thread * threads = new std::thread[a_threads];
+	double ms = benchBest(3, [&]()
+	{
+		for(int t = 0; t < a_threads; ++t)
+		{
+			threads[t] = std::thread([&a_map, t, a_readPercent]()
+			{
+				BenchRandom random(0x9e3779b97f4a7c15ull * (t+1));
+				int value, found = 0;
+				for(int i = 0; i < OPERATIONS; ++i)
+				{
+					unsigned long long r = random.next();
+					const int key = (int)(r % KEYS);
+					const int op = (int)((r >> 32) % 100);
+					if(op < a_readPercent)
+						found += a_map.getByKey(key, value);
+					else if(op & 1)
+						a_map.set(key, i);
+					else
+						a_map.erase(key);
+				}
+				// keeps the reads from being optimized away
+				if(found < 0)
+					printf("%d\n", found);
+			});
+		}
+		for(int t = 0; t < a_threads; ++t)
+		{
+			threads[t].join();
+		}
+	});
+	delete [] threads;
+	return (double)a_threads * OPERATIONS / (ms * 1000);
+}
+
+/** fills a_map with every other key */
+template<typename MAP>
+void fill(MAP & a_map)
+{
+	for(int key = 0; key < KEYS; key += 2)
+	{
+		a_map.set(key, key);
+	}
+}
+
+int main(int argc, char ** argv)
+{
+	benchInit();
+	int maxThreads = (argc > 1) ? atoi(argv[1]) : 2*(int)std::thread::hardware_concurrency();
+	if(maxThreads < 1)
+		maxThreads = 1;
+	printf("%d cores, %d keys, %d operations per thread\n",
+		(int)std::thread::hardware_concurrency(), KEYS, OPERATIONS);
+	printf("%-10s %8s %18s %18s\n", "reads", "threads", "64 shards Mops/s", "1 shard Mops/s");
+	const int readPercents[] = { 90, 50 };
+	for(int p = 0; p < 2; ++p)
+	{
+		for(int threads = 1; threads <= maxThreads; threads *= 2)
+		{
+			TemplateHashMapConcurrent<int, int> sharded;
+			TemplateHashMapConcurrent<int, int, TemplateHasher<int>, 1> single;
+			fill(sharded);
+			fill(single);
+			double shardedOps = throughput(sharded, threads, readPercents[p]);
+			double singleOps = throughput(single, threads, readPercents[p]);
+			printf("%8d%% %8d %18.2f %18.2f\n", readPercents[p], threads, shardedOps, singleOps);
+		}
+	}
+	return 0;
+}
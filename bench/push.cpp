@@ -0,0 +1,47 @@
+/**
+ * times TemplateVector::add on push-heavy workloads, where most of the cost
+ * beyond the writes is moving the elements each time the vector grows.
+ * cd bench && g++ -std=c++11 -O2 -pthread -I.. push.cpp ../mem.cpp -o push && ./push
+ * add -DTEMPLATEARRAY_USES_MALLOC to time growing with realloc
+ */
+#include "bench.h"
+#include "templatevector.h"
+#include "v2.h"
+
+/** a cache line big, so relocation is most of the work */
+struct Particle
+{
+	V2F position, velocity;
+	float mass, drag, life, age;
+	int id, flags, group, padding[5];
+};
+
+/** pushes a_count elements into one vector, a_vectors times */
+template<typename DATA_TYPE>
+double pushInto(const int a_vectors, const int a_count, DATA_TYPE const & a_value)
+{
+	return benchBest(5, [&]()
+	{
+		for(int v = 0; v < a_vectors; ++v)
+		{
+			TemplateVector<DATA_TYPE> list;
+			for(int i = 0; i < a_count; ++i)
+			{
+				list.add(a_value);
+			}
+		}
+	});
+}
+
+int main()
+{
+	benchInit();
+	Particle particle = Particle();
+	printf("%-34s %10s\n", "workload", "best ms");
+	printf("%-34s %10.2f\n", "1 x 4M int", pushInto(1, 1 << 22, 7));
+	printf("%-34s %10.2f\n", "1 x 2M V2F", pushInto(1, 1 << 21, V2F(1, 2)));
+	printf("%-34s %10.2f\n", "1 x 500k Particle", pushInto(1, 500000, particle));
+	printf("%-34s %10.2f\n", "20000 x 100 V2F", pushInto(20000, 100, V2F(1, 2)));
+	printf("%-34s %10.2f\n", "20000 x 100 Particle", pushInto(20000, 100, particle));
+	return 0;
+}
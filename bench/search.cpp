@@ -0,0 +1,91 @@
+/**
+ * times binary search on sorted ints: a textbook search that branches on
+ * each comparison, the branch-free TemplateArray::lowerBound, and
+ * TemplateFrozenVector's Eytzinger layout, on lists that fit in L1, in L2,
+ * and in neither
+ * cd bench && g++ -std=c++11 -O2 -pthread -I.. search.cpp ../mem.cpp -o search && ./search
+ */
+#include "bench.h"
+#include "templatevector.h"
+#include "templatefrozenvector.h"
+
+/** lookups per list */
+static const int LOOKUPS = 1 << 21;
+
+/** lower bound the way std::lower_bound does it, with a branch on each comparison */
+inline int textbookLowerBound(int const * a_data, int a_count, const int a_value)
+{
+	int first = 0;
+	while(a_count > 0)
+	{
+		const int half = a_count / 2;
+		if(a_data[first+half] < a_value)
+		{
+			first += half+1;
+			a_count -= half+1;
+		}
+		else
+		{
+			a_count = half;
+		}
+	}
+	return first;
+}
+
+/**
+ * looks up every key in a_keys with a_search
+ * @return milliseconds, and the sum of the indexes found in a_sum
+ */
+template<typename SEARCH>
+double timeLookups(TemplateVector<int> const & a_keys, long long & a_sum, SEARCH a_search)
+{
+	return benchBest(3, [&]()
+	{
+		long long sum = 0;
+		for(int i = 0; i < a_keys.size(); ++i)
+		{
+			sum += a_search(a_keys.getCONST(i));
+		}
+		a_sum = sum;
+	});
+}
+
+int main()
+{
+	benchInit();
+	const int sizes[] = { 1 << 10, 1 << 16, 10000000 };
+	printf("%10s %12s %12s %12s   (ms for %d lookups)\n", "elements", "textbook", "branch-free", "Eytzinger", LOOKUPS);
+	for(int s = 0; s < 3; ++s)
+	{
+		const int count = sizes[s];
+		// even numbers, so half the lookups miss
+		TemplateVector<int> sorted;
+		sorted.setSize(count);
+		for(int i = 0; i < count; ++i)
+		{
+			sorted[i] = i*2;
+		}
+		TemplateFrozenVector<int> frozen(sorted);
+		TemplateVector<int> keys;
+		keys.setSize(LOOKUPS);
+		BenchRandom random;
+		for(int i = 0; i < LOOKUPS; ++i)
+		{
+			keys[i] = (int)(random.next() % (unsigned long long)(count*2));
+		}
+		int const * begin = sorted.getRawListConst();
+		long long textbookSum, branchFreeSum, eytzingerSum;
+		double textbookMs = timeLookups(keys, textbookSum, [&](int a_key){
+			return textbookLowerBound(begin, count, a_key);
+		});
+		double branchFreeMs = timeLookups(keys, branchFreeSum, [&](int a_key){
+			return sorted.lowerBound(a_key, 0, count);
+		});
+		double eytzingerMs = timeLookups(keys, eytzingerSum, [&](int a_key){
+			return frozen.lowerBound(a_key);
+		});
+		printf("%10d %12.2f %12.2f %12.2f%s\n", count, textbookMs, branchFreeMs, eytzingerMs,
+			(textbookSum == branchFreeSum && textbookSum == eytzingerSum) ? "" : "   RESULTS DIFFER");
+	}
+	return 0;
+}
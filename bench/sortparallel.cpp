@@ -0,0 +1,105 @@
+/**
+ * times sortParallel against sort on a few million elements, for 1, 2, 4...
+ * threads up to the argument (default: twice the cores)
+ * cd bench && g++ -std=c++11 -O2 -pthread -I.. sortparallel.cpp ../mem.cpp -o sortparallel && ./sortparallel
+ */
+#include "bench.h"
+#include "templatevector.h"
+#include "templatesortparallel.h"
+
+#include <stdlib.h>	// atoi
+#include <string.h>	// memcpy
+
+/** sorted by key, with a comparator, so chunks are introsorted rather than radix sorted */
+struct Record
+{
+	unsigned int key;
+	int payload[3];
+};
+
+struct RecordBefore
+{
+	inline bool operator()(Record const & a, Record const & b) const { return a.key < b.key; }
+};
+
+/** @return true if a_data is in order */
+template<typename DATA_TYPE, typename LESS>
+bool isSorted(DATA_TYPE const * a_data, const int a_count, LESS less)
+{
+	for(int i = 1; i < a_count; ++i)
+	{
+		if(less(a_data[i], a_data[i-1]))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * prints the serial time, then the time and speedup of each thread count
+ * @param a_sort called as a_sort(data, count, threads), threads 0 for serial
+ */
+template<typename DATA_TYPE, typename LESS, typename SORT>
+void timeSorts(const char * a_name, DATA_TYPE const * a_input, const int a_count, const int a_maxThreads, LESS less, SORT a_sort)
+{
+	TemplateVector<DATA_TYPE> data;
+	data.setSize(a_count);
+	DATA_TYPE * list = &data[0];
+	const int runs = 5;
+	bool sorted = true;
+	double serial = benchBest(runs,
+		[&](){ memcpy((void*)list, (const void*)a_input, sizeof(DATA_TYPE)*a_count); },
+		[&](){ a_sort(list, a_count, 0); });
+	sorted = sorted && isSorted(list, a_count, less);
+	printf("%-22s serial %8.2f ms\n", a_name, serial);
+	for(int threads = 1; threads <= a_maxThreads; threads *= 2)
+	{
+		double ms = benchBest(runs,
+			[&](){ memcpy((void*)list, (const void*)a_input, sizeof(DATA_TYPE)*a_count); },
+			[&](){ a_sort(list, a_count, threads); });
+		sorted = sorted && isSorted(list, a_count, less);
+		printf("%-22s %2d threads %8.2f ms  %5.2fx serial\n", "", threads, ms, serial/ms);
+	}
+	if(!sorted)
+		printf("%-22s NOT SORTED\n", a_name);
+}
+
+int main(int argc, char ** argv)
+{
+	benchInit();
+	int maxThreads = (argc > 1) ? atoi(argv[1]) : 2*(int)std::thread::hardware_concurrency();
+	if(maxThreads < 1)
+		maxThreads = 1;
+	printf("%d cores\n", (int)std::thread::hardware_concurrency());
+	const int count = 1 << 22;
+	BenchRandom random;
+	TemplateVector<int> ints;
+	TemplateVector<double> doubles;
+	TemplateVector<Record> records;
+	ints.setSize(count);
+	doubles.setSize(count);
+	records.setSize(count);
+	for(int i = 0; i < count; ++i)
+	{
+		unsigned long long r = random.next();
+		ints[i] = (int)r;
+		doubles[i] = (double)(r >> 11) / (double)(1ull << 53) - 0.5;
+		records[i].key = (unsigned int)(r >> 32);
+		records[i].payload[0] = records[i].payload[1] = records[i].payload[2] = i;
+	}
+	timeSorts("4M int", &ints[0], count, maxThreads, TemplateSort::Less<int>(),
+		[](int * a_data, int a_count, int a_threads){
+			if(a_threads) TemplateSort::parallelSort(a_data, a_count, a_threads);
+			else TemplateSort::sort(a_data, a_count);
+		});
+	timeSorts("4M double", &doubles[0], count, maxThreads, TemplateSort::Less<double>(),
+		[](double * a_data, int a_count, int a_threads){
+			if(a_threads) TemplateSort::parallelSort(a_data, a_count, a_threads);
+			else TemplateSort::sort(a_data, a_count);
+		});
+	timeSorts("4M Record, comparator", &records[0], count, maxThreads, RecordBefore(),
+		[](Record * a_data, int a_count, int a_threads){
+			if(a_threads) TemplateSort::parallelSort(a_data, a_count, RecordBefore(), a_threads);
+			else TemplateSort::introsort(a_data, a_count, RecordBefore());
+		});
+	return 0;
+}
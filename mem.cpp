@@ -10,19 +10,26 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>	// memset
+#include <time.h>	// clock, for the heap profile's churn rates
 
-#define MEM_LINKED_LIST
-
-#define VERIFY_INTEGRITY
+#ifdef USE_CUSTOM_MEMORY_MANAGEMENT_THREADS
+#include <atomic>
+#include <thread>	// std::this_thread::yield
+#ifndef MEM_LEAK_DEBUG
+/** each thread keeps small free blocks for itself. debug builds lock every call instead, so the whole heap can be checked */
+#define MEM_THREAD_CACHE
+#endif
+#endif
 
 // forward reference
 struct MemPage;
 
-#define SIZEOFFLAG 1
+#define SIZEOFFLAG 4
 #ifdef ENVIRONMENT32
-#define SIZEOFMEMBLOCKSIZE	31
+#define SIZEOFMEMBLOCKSIZE	28
 #elif defined(ENVIRONMENT64)
-#define SIZEOFMEMBLOCKSIZE	63
+#define SIZEOFMEMBLOCKSIZE	60
 #endif
 
 
@@ -35,15 +42,19 @@ struct MemPage;
 class MemBlock{
 	/** this is a free block, it can be given out to callers who ask for memory */
 	static const int FREE = 1 << 0;
-	/** how many bytes this header is in front of (the size of the allocation), only 31 bits given. value does not include the header's size */
+	/** the block right before this one in the page is free, so its size is in the footer right before this header */
+	static const int PREV_FREE = 1 << 1;
+	/** this is the last block in its memory page */
+	static const int LAST = 1 << 2;
+	/** this used block ends with a guard, see MemManager::writeGuard */
+	static const int GUARDED = 1 << 3;
+	/** how many bytes this header is in front of (the size of the allocation), only 28 bits given. value does not include the header's size */
 	size_t size:SIZEOFMEMBLOCKSIZE;
-	/** whether or not this memory block is free or not, only 1 bit given */
+	/** FREE, PREV_FREE, LAST and GUARDED, only 4 bits given */
 	size_t flag:SIZEOFFLAG;
 public:
-#ifdef MEM_LINKED_LIST
-	/** when blocks are in a sequence (active/free block lists) */
+	/** when blocks are in a sequence (free block lists) */
 	MemBlock * next;
-#endif
 #ifdef MEM_LEAK_DEBUG
 	size_t signature;
 	const char * filename;
@@ -73,6 +84,27 @@ public:
 	inline void markUsed(){
 		flag &= ~MemBlock::FREE;
 	}
+	/** @return true if the block right before this one in the page is free */
+	inline bool isPrevFree(){
+		return (flag & MemBlock::PREV_FREE) != 0;
+	}
+	inline void setPrevFree(bool a_free){
+		if(a_free) flag |= MemBlock::PREV_FREE; else flag &= ~MemBlock::PREV_FREE;
+	}
+	/** @return true if this is the last block in its memory page (there is no nextContiguousBlock) */
+	inline bool isLast(){
+		return (flag & MemBlock::LAST) != 0;
+	}
+	inline void setLast(bool a_last){
+		if(a_last) flag |= MemBlock::LAST; else flag &= ~MemBlock::LAST;
+	}
+	/** @return true if this used block ends with a guard */
+	inline bool isGuarded(){
+		return (flag & MemBlock::GUARDED) != 0;
+	}
+	inline void setGuarded(bool a_guarded){
+		if(a_guarded) flag |= MemBlock::GUARDED; else flag &= ~MemBlock::GUARDED;
+	}
 	/** how many usable bytes this block manages. total size of the block is getSize()+sizeof(MemBlock) */
 	inline size_t getSize(){
 		return size;
@@ -97,6 +129,17 @@ public:
 	{
 		return (MemBlock*)(((ptrdiff_t)memory)-sizeof(MemBlock));
 	}
+	/**
+	 * the boundary tag at the end of a free block: a copy of its size, in
+	 * the last bytes of its usable memory, where the next block can find it
+	 */
+	inline size_t & footer(){
+		return *(size_t*)((ptrdiff_t)this+sizeof(MemBlock)+getSize()-sizeof(size_t));
+	}
+	/** @return the free block right before this one in the page, found by its footer. only valid if isPrevFree() */
+	inline MemBlock * prevFreeBlock(){
+		return (MemBlock*)((ptrdiff_t)this-(ptrdiff_t)(((size_t*)this)[-1]+sizeof(MemBlock)));
+	}
 };
 int MEM::getAllocatedHere(void * a_memory)
 {
@@ -114,49 +157,425 @@ struct MemPage{
 	}
 };
 
-/** manages memory */
+/**
+ * kept in the usable memory of a free block (where the caller's data was),
+ * linking it to the other free blocks of its size. the next link is the
+ * MemBlock's own. a block of usable size MEM_SMALL_LIMIT or more also keeps
+ * its place in a tree of free blocks.
+ */
+struct MemFreeLinks{
+	/** the block before this one in its list, 0 if this block is the first */
+	MemBlock * prev;
+	/** the blocks below this one in the tree, only for blocks that are in the tree */
+	MemBlock * child[2];
+	/** the block above this one in the tree, 0 for the root */
+	MemBlock * parent;
+};
+
+/** @return index of the highest set bit in a_value, which must not be 0 */
+static inline int highestBit(unsigned long long a_value){
+#if defined(__GNUC__) || defined(__clang__)
+	return 63 - __builtin_clzll(a_value);
+#else
+	int index = 0;
+	while(a_value >>= 1)
+		++index;
+	return index;
+#endif
+}
+/** @return index of the lowest set bit in a_value, which must not be 0 */
+static inline int lowestBit(unsigned long long a_value){
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctzll(a_value);
+#else
+	int index = 0;
+	while(!(a_value & 1)){
+		a_value >>= 1;
+		++index;
+	}
+	return index;
+#endif
+}
+
+/** usable sizes are always a multiple of this */
+#define MEM_ALIGNMENT	sizeof(ptrdiff_t)
+/** the smallest usable size: enough for a free block's prev link and footer */
+#define MEM_MIN_SIZE	(2*MEM_ALIGNMENT)
+/** free blocks smaller than this are binned by exact size. bigger ones go in the tree */
+#define MEM_SMALL_LIMIT	256
+/** how many exact-size bins there are (bin i holds usable size i*MEM_ALIGNMENT) */
+#define MEM_SMALL_BINS	(MEM_SMALL_LIMIT/MEM_ALIGNMENT)
+/** bits in a size_t, and so how many tree bins there are */
+#define MEM_SIZE_BITS	(8*sizeof(size_t))
+
+#ifdef USE_CUSTOM_MEMORY_MANAGEMENT_THREADS
+/** a spin lock around the shared heap. spins briefly, then yields the thread */
+class MemLock{
+	std::atomic<bool> m_locked;
+public:
+	MemLock():m_locked(false){}
+	void lock(){
+		int attempt = 0;
+		while(m_locked.exchange(true, std::memory_order_acquire)){
+			// wait until it looks free before trying again, without writing to it
+			while(m_locked.load(std::memory_order_relaxed)){
+				if(++attempt > 16)
+					std::this_thread::yield();
+			}
+		}
+	}
+	void unlock(){
+		m_locked.store(false, std::memory_order_release);
+	}
+};
+#endif
+
+#ifdef MEM_THREAD_CACHE
+/** how many free blocks of one size a thread keeps for itself */
+#define MEM_CACHE_LIMIT	64
+/** how many blocks a thread takes from the shared heap at once, when it has none of a size */
+#define MEM_CACHE_BATCH	16
+
+struct MemThreadCache;
+
+/** the cached blocks of one size in a MemThreadCache */
+struct MemCacheBin{
+	/** the cached blocks, linked by next */
+	MemBlock * blocks;
+	/** how many blocks are in the list */
+	int count;
+	/** the cache this bin is in */
+	MemThreadCache * cache;
+};
+
+/**
+ * small blocks kept by one thread, so it can allocate and free them without
+ * taking the heap's lock. the shared heap counts cached blocks as used. a
+ * used block that came from a cache points at its MemCacheBin with its next,
+ * so a free on any thread knows where to send it back without reading the
+ * block's size, which the shared heap's flags share a word with.
+ */
+struct MemThreadCache{
+	/** bins[i] has the cached blocks with usable size i*MEM_ALIGNMENT */
+	MemCacheBin bins[MEM_SMALL_BINS];
+	/**
+	 * blocks freed by other threads, waiting for this thread to take them
+	 * back all at once. linked through their first word, since their next
+	 * still points at their bin
+	 */
+	std::atomic<MemBlock*> remoteFrees;
+	/** every cache there is, so a new thread can adopt one whose thread ended */
+	MemThreadCache * nextCache;
+	/** whether a thread is using this cache */
+	bool inUse;
+	MemThreadCache():remoteFrees(0),nextCache(0),inUse(false){
+		for(size_t i = 0; i < MEM_SMALL_BINS; ++i){
+			bins[i].blocks = 0;
+			bins[i].count = 0;
+			bins[i].cache = this;
+		}
+	}
+	/** @return the next block in a remoteFrees list */
+	static inline MemBlock * & nextRemoteFree(MemBlock * a_block){
+		return *(MemBlock**)a_block->allocatedMemory();
+	}
+};
+
+/** this thread's cache. 0 until the thread first allocates */
+static thread_local MemThreadCache * t_cache = 0;
+/** set once this thread has ended, so anything it frees after that goes straight to the shared heap */
+static thread_local bool t_cacheRetired = false;
+/** gives this thread's cache back to the heap when the thread ends */
+struct MemThreadCacheRetirer{
+	~MemThreadCacheRetirer();
+};
+static thread_local MemThreadCacheRetirer t_cacheRetirer;
+#endif
+
+/** allocations left on this thread until the next one is guarded, at MEM::DEBUG_SAMPLED */
+static MEM_THREAD_LOCAL int t_guardCountdown = 0;
+
+/**
+ * manages memory. free blocks are indexed by size, so finding one is
+ * constant time, however fragmented the heap is:
+ * - small blocks are in smallBins, one doubly-linked list per exact size. a
+ *   bitmap of the bins that have blocks finds the smallest one that fits.
+ * - bigger blocks are in treeBins, one per power of 2. each is a bitwise
+ *   trie (as in Doug Lea's malloc): a block's child is picked by the next
+ *   bit of its size, so a best-fit search is at most one step per bit.
+ *   blocks of the same size hang off the tree node in a list.
+ * freeing is constant time too: a free block keeps its size in a footer, and
+ * the block after it is marked PREV_FREE, so a freed block finds both of its
+ * neighbours without searching, and merges with them.
+ *
+ * with USE_CUSTOM_MEMORY_MANAGEMENT_THREADS, the heap is shared by every
+ * thread behind a lock, and each thread caches small blocks (allocateForThread,
+ * deallocateForThread), so most calls never take the lock.
+ *
+ * how much checking is done is picked at runtime, see MEM::DebugLevel.
+ */
 struct MemManager{
 	/** the first memory page, which links to subsequent pages like a linked list */
 	MemPage* mem;
 	/** the default page size */
 	size_t defaultPageSize;
-#ifdef MEM_LINKED_LIST
-	/** singly-linked list of used memory */
-	MemBlock * usedList;
-	/** singly-linked list of free memory */
-	MemBlock * freeList;
+	/** smallBins[i] lists the free blocks with usable size i*MEM_ALIGNMENT */
+	MemBlock * smallBins[MEM_SMALL_BINS];
+	/** bit i is set if smallBins[i] has blocks */
+	unsigned long long smallMap;
+	/** treeBins[k] is the root of the tree of free blocks with usable size in [2^k, 2^(k+1)) */
+	MemBlock * treeBins[MEM_SIZE_BITS];
+	/** bit k is set if treeBins[k] has blocks */
+	unsigned long long treeMap;
+#ifdef USE_CUSTOM_MEMORY_MANAGEMENT_THREADS
+	/** held while the shared heap is used */
+	MemLock lock;
 #endif
+#ifdef MEM_THREAD_CACHE
+	/** every thread cache, linked by nextCache */
+	MemThreadCache * caches;
+#endif
+#ifdef USE_CUSTOM_MEMORY_MANAGEMENT_THREADS
+	/** a MEM::DebugLevel. read without the lock */
+	std::atomic<int> debugLevel;
+	/** the N of MEM::DEBUG_SAMPLED */
+	std::atomic<int> sampleRate;
+#else
+	int debugLevel, sampleRate;
+#endif
+	/** calls to the shared heap since the last sampled verifyIntegrity */
+	int sampleCounter;
+	/** how many corruptions the checks have found */
+	int debugFailures;
 #ifdef MEM_LEAK_DEBUG
 	unsigned int largestRequest;
 	unsigned int smallRequestSize;
 	int numSmallRequests;
 	int numAllocations;
+	/** the heap profile: an open-addressed table of profileCapacity sites (a power of 2), malloc'd */
+	MEM::HeapSite * profileSites;
+	int profileCapacity, profileCount;
+	/** whether allocations and frees are being counted */
+	bool profiling;
+	/** the first allocID the profile counts. blocks allocated before it started are not in it */
+	size_t profileStart;
+	/** when the profile started, to give churn as a rate */
+	clock_t profileClock;
 #endif
 	MemManager():mem(0),defaultPageSize(PAGE_SIZE_DEFAULT)
-#ifdef MEM_LINKED_LIST
-		,usedList(0),freeList(0)
+#ifdef MEM_THREAD_CACHE
+		,caches(0)
+#endif
+#ifdef USE_CUSTOM_MEMORY_MANAGEMENT_DEBUG
+		,debugLevel(MEM::DEBUG_FULL)
+#else
+		,debugLevel(MEM::DEBUG_OFF)
 #endif
+		,sampleRate(1024),sampleCounter(0),debugFailures(0)
 #ifdef MEM_LEAK_DEBUG
 		,largestRequest(0),smallRequestSize(32),numSmallRequests(0),numAllocations(0)
+		,profileSites(0),profileCapacity(0),profileCount(0),profiling(false),profileStart(0),profileClock(0)
 #endif
-	{}
+	{
+		clearFreeIndex();
+	}
 
-#ifdef MEM_LINKED_LIST
-	/** @return a pointer to the pointer that points at the last block */
-	MemBlock ** ptrTolastBlock(MemBlock * & whichList){
-		MemBlock ** ptr = &whichList;
-		while(*ptr){
-			ptr = &((*ptr)->next);
-#ifdef MEM_LEAK_DEBUG
-			if(*ptr == whichList){
-				printf("singly-linked list became circular...");
-				int i=0;i=1/i;
+	/** forgets every free block */
+	void clearFreeIndex(){
+		for(size_t i = 0; i < MEM_SMALL_BINS; ++i)
+			smallBins[i] = 0;
+		for(size_t i = 0; i < MEM_SIZE_BITS; ++i)
+			treeBins[i] = 0;
+		smallMap = treeMap = 0;
+	}
+
+	static inline MemFreeLinks * linksOf(MemBlock * a_block){
+		return (MemFreeLinks*)a_block->allocatedMemory();
+	}
+
+	/** adds a free block to the free index, and writes its footer */
+	void insertFree(MemBlock * a_block){
+		const size_t size = a_block->getSize();
+		a_block->footer() = size;
+		MemFreeLinks * links = linksOf(a_block);
+		links->prev = 0;
+		if(size < MEM_SMALL_LIMIT){
+			// push onto the front of its bin
+			const int bin = (int)(size / MEM_ALIGNMENT);
+			a_block->next = smallBins[bin];
+			if(a_block->next)
+				linksOf(a_block->next)->prev = a_block;
+			smallBins[bin] = a_block;
+			smallMap |= 1ull << bin;
+			return;
+		}
+		const int bin = highestBit(size);
+		links->child[0] = links->child[1] = 0;
+		links->parent = 0;
+		a_block->next = 0;
+		if(!treeBins[bin]){
+			treeBins[bin] = a_block;
+			treeMap |= 1ull << bin;
+			return;
+		}
+		// the bits below the bin's top bit pick the path down the tree
+		size_t bits = size << (MEM_SIZE_BITS-bin);
+		MemBlock * node = treeBins[bin];
+		while(true){
+			if(node->getSize() == size){
+				// same size as a block in the tree: go in the list after it
+				a_block->next = node->next;
+				if(node->next)
+					linksOf(node->next)->prev = a_block;
+				node->next = a_block;
+				links->prev = node;
+				return;
 			}
-#endif
+			MemBlock ** child = &linksOf(node)->child[(bits >> (MEM_SIZE_BITS-1)) & 1];
+			bits <<= 1;
+			if(!*child){
+				*child = a_block;
+				links->parent = node;
+				return;
+			}
+			node = *child;
 		}
-		return ptr;
 	}
-#endif
+
+	/** takes a free block out of the free index */
+	void removeFree(MemBlock * a_block){
+		const size_t size = a_block->getSize();
+		MemFreeLinks * links = linksOf(a_block);
+		if(size < MEM_SMALL_LIMIT || links->prev){
+			// in a list, but not a tree node: just unlink it
+			if(links->prev)
+				links->prev->next = a_block->next;
+			else{
+				const int bin = (int)(size / MEM_ALIGNMENT);
+				smallBins[bin] = a_block->next;
+				if(!a_block->next)
+					smallMap &= ~(1ull << bin);
+			}
+			if(a_block->next)
+				linksOf(a_block->next)->prev = links->prev;
+			return;
+		}
+		// a tree node. the next block of the same size takes its place, or
+		// else a leaf from under it, or else nothing
+		MemBlock * replacement = a_block->next;
+		if(replacement){
+			linksOf(replacement)->prev = 0;
+		}else{
+			MemBlock ** from = &links->child[1];
+			if(!*from)
+				from = &links->child[0];
+			replacement = *from;
+			if(replacement){
+				while(true){
+					MemFreeLinks * r = linksOf(replacement);
+					MemBlock ** deeper = r->child[1] ? &r->child[1] : &r->child[0];
+					if(!*deeper)
+						break;
+					from = deeper;
+					replacement = *deeper;
+				}
+				*from = 0;
+			}
+		}
+		MemBlock * parent = links->parent;
+		const int bin = highestBit(size);
+		if(treeBins[bin] == a_block){
+			treeBins[bin] = replacement;
+			if(!replacement)
+				treeMap &= ~(1ull << bin);
+		}else{
+			MemFreeLinks * p = linksOf(parent);
+			p->child[(p->child[0] == a_block) ? 0 : 1] = replacement;
+		}
+		if(replacement){
+			MemFreeLinks * r = linksOf(replacement);
+			r->parent = parent;
+			for(int c = 0; c < 2; ++c){
+				r->child[c] = links->child[c];
+				if(r->child[c])
+					linksOf(r->child[c])->parent = replacement;
+			}
+		}
+	}
+
+	/**
+	 * @param a_tree a subtree of free blocks
+	 * @param a_best the best fit so far, and how much bigger than a_size it is.
+	 * updated if a_tree has a better one
+	 */
+	static void smallestInTree(MemBlock * a_tree, const size_t a_size, MemBlock * & a_best, size_t & a_bestExtra){
+		// in a bitwise trie, the smallest block is on the path that goes left whenever it can
+		while(a_tree){
+			const size_t extra = a_tree->getSize() - a_size;
+			if(a_tree->getSize() >= a_size && extra < a_bestExtra){
+				a_bestExtra = extra;
+				a_best = a_tree;
+			}
+			MemFreeLinks * links = linksOf(a_tree);
+			a_tree = links->child[0] ? links->child[0] : links->child[1];
+		}
+	}
+
+	/** @return the smallest free block in the tree with at least a_size usable bytes, 0 if there is none */
+	MemBlock * bestFitInTree(const size_t a_size){
+		MemBlock * best = 0;
+		size_t bestExtra = ~(size_t)0;
+		const int bin = highestBit(a_size);
+		if(treeMap & (1ull << bin)){
+			// follow a_size's path. the subtrees to the right of the path hold bigger blocks
+			size_t bits = a_size << (MEM_SIZE_BITS-bin);
+			MemBlock * node = treeBins[bin];
+			MemBlock * biggerSubtree = 0;
+			while(node){
+				const size_t extra = node->getSize() - a_size;
+				if(node->getSize() >= a_size && extra < bestExtra){
+					bestExtra = extra;
+					best = node;
+					if(!extra)
+						return best;
+				}
+				MemFreeLinks * links = linksOf(node);
+				MemBlock * right = links->child[1];
+				node = links->child[(bits >> (MEM_SIZE_BITS-1)) & 1];
+				if(right && right != node)
+					biggerSubtree = right;
+				bits <<= 1;
+			}
+			smallestInTree(biggerSubtree, a_size, best, bestExtra);
+		}
+		if(!best){
+			// any block in a bigger bin fits, so take the smallest of the first one
+			const unsigned long long bigger = (bin+1 < (int)MEM_SIZE_BITS) ? (treeMap & ~((2ull << bin)-1)) : 0;
+			if(bigger)
+				smallestInTree(treeBins[lowestBit(bigger)], a_size, best, bestExtra);
+		}
+		return best;
+	}
+
+	/** @return the smallest free block with at least a_size usable bytes, taken out of the free index. 0 if there is none */
+	MemBlock * takeFree(const size_t a_size){
+		MemBlock * block = 0;
+		if(a_size < MEM_SMALL_LIMIT){
+			const unsigned long long fits = smallMap & ~((1ull << (a_size / MEM_ALIGNMENT))-1);
+			if(fits)
+				block = smallBins[lowestBit(fits)];
+		}
+		if(!block)
+			block = bestFitInTree((a_size < MEM_SMALL_LIMIT) ? MEM_SMALL_LIMIT : a_size);
+		if(block){
+			// a block in the list after a tree node comes out without changing the tree
+			if(block->getSize() >= MEM_SMALL_LIMIT && block->next)
+				block = block->next;
+			removeFree(block);
+		}
+		return block;
+	}
+
 	/** create a new memory page to be managed (uses malloc) */
 	MemPage* newPage(size_t pagesize){
 		MemPage * m = (MemPage*)malloc(pagesize);
@@ -168,10 +587,11 @@ struct MemManager{
 		m->size = pagesize;
 		MemBlock * memoryUnit = m->firstBlock();
 		memoryUnit->markFree();
+		memoryUnit->setPrevFree(false);
+		memoryUnit->setLast(true);
+		memoryUnit->setGuarded(false);
 		memoryUnit->setSize(((signed)m->size)-(signed)sizeof(MemPage)-(signed)sizeof(MemBlock));
-#ifdef MEM_LINKED_LIST
 		memoryUnit->next = 0;
-#endif
 #ifdef MEM_LEAK_DEBUG
 		// replace __FILE__ and __LINE__ with hex for "newBlock","-unused-" or "newB", "lock" for 32 bit
 		memoryUnit->setupDebugInfo(__FILE__, __LINE__, numAllocations++);
@@ -201,26 +621,17 @@ struct MemManager{
 	MemPage* addPage(size_t size){
 		MemPage** lastP = lastPage();
 		*lastP = newPage(size);
-#ifdef MEM_LINKED_LIST
-//		printf("addPage\n");
-		MemBlock ** ptrToLast = ptrTolastBlock(freeList);
-		(*ptrToLast) = (*lastP)->firstBlock();
-#endif
+		insertFree((*lastP)->firstBlock());
 		return *lastP;
 	}
 	MemPage* addPageAtLeastBigEnoughFor(size_t size){
 		MemPage** lastP = lastPage();
 		*lastP = newPageAtLeastBigEnoughFor(size);
-#ifdef MEM_LINKED_LIST
-//		printf("addPageAtLeastBigEnoughFor\n");
-		MemBlock ** ptrToLast = ptrTolastBlock(freeList);
-		(*ptrToLast) = (*lastP)->firstBlock();
-#endif
+		insertFree((*lastP)->firstBlock());
 		return *lastP;
 	}
 
-#ifdef MEM_LEAK_DEBUG
-#ifdef VERIFY_INTEGRITY
+	/** walks every block of every page, checking headers, boundary tags and guards */
 	bool verifyIntegrity(const char * failMessage){
 		MemPage * current = mem;
 		if(current){
@@ -234,18 +645,35 @@ struct MemManager{
 				MemBlock* block = current->firstBlock();
 				firstHeaderLoc = (ptrdiff_t)block;
 				MemBlock* endOfThisPage = (MemBlock*)endOfPage(current);
-				MemBlock * last;
+				MemBlock * last = 0;
 				// verify going forwards
 				do{
-					last = block;
+#ifdef MEM_LEAK_DEBUG
 					if(block->signature != MEM_LEAK_DEBUG){
 						printf("\n%s\n\nintegrity failure at page %d, header %d (%d/%d)\n\n\n", failMessage,
 							pages, usedSectors+freeSectors, ((ptrdiff_t)block)-firstHeaderLoc, ((ptrdiff_t)endOfThisPage)-firstHeaderLoc);
 						// TODO memviewer right here...
 //						printMem();
 //						_getch();
+						debugFailures++;
+						return false;
+					}
+#endif
+					// the boundary tags must agree with the blocks around this one
+					bool prevFree = last && last->isFree();
+					if(block->getSize() > (size_t)((ptrdiff_t)endOfThisPage-(ptrdiff_t)block)
+					|| block->isPrevFree() != prevFree || (prevFree && block->prevFreeBlock() != last)
+					|| block->isLast() != ((ptrdiff_t)block->nextContiguousBlock() >= (ptrdiff_t)endOfThisPage)){
+						printf("\n%s\n\nboundary tag failure at page %d, header %d (%d/%d)\n\n\n", failMessage,
+							(int)pages, (int)(usedSectors+freeSectors), (int)(((ptrdiff_t)block)-firstHeaderLoc),
+							(int)(((ptrdiff_t)endOfThisPage)-firstHeaderLoc));
+						debugFailures++;
+						return false;
+					}
+					if(!block->isFree() && block->isGuarded() && !checkGuard(block, failMessage)){
 						return false;
 					}
+					last = block;
 					if(!block->isFree()){
 						usedSectors++;
 						usedBytes += block->getSize();
@@ -262,14 +690,181 @@ struct MemManager{
 		}
 		return true;
 	}
+
+	/** runs verifyIntegrity if the debug level says this call to the shared heap should be checked */
+	inline void sampleIntegrity(const char * a_when){
+		const int level = debugLevel;
+		if(level == MEM::DEBUG_FULL || (level == MEM::DEBUG_SAMPLED && ++sampleCounter >= sampleRate)){
+			sampleCounter = 0;
+			verifyIntegrity(a_when);
+		}
+	}
+
+	/**
+	 * marks the end of a used block, to catch writes past the a_size bytes
+	 * the caller asked for: the block's last word is MEM_GUARD^a_size, and
+	 * the bytes between the caller's memory and that word are MEM_GUARD_BYTE
+	 */
+	static void writeGuard(MemBlock * a_block, size_t a_size){
+		unsigned char * memory = (unsigned char*)a_block->allocatedMemory();
+		size_t * guard = (size_t*)(memory+a_block->getSize())-1;
+		for(unsigned char * cursor = memory+a_size; cursor < (unsigned char*)guard; ++cursor){
+			*cursor = MEM_GUARD_BYTE;
+		}
+		*guard = a_size ^ (size_t)MEM_GUARD;
+		a_block->setGuarded(true);
+	}
+	/** @return false (and reports it) if something wrote past the end of a guarded block's memory */
+	bool checkGuard(MemBlock * a_block, const char * failMessage){
+		unsigned char * memory = (unsigned char*)a_block->allocatedMemory();
+		size_t * guard = (size_t*)(memory+a_block->getSize())-1;
+		size_t size = *guard ^ (size_t)MEM_GUARD;
+		bool intact = size <= (size_t)((unsigned char*)guard-memory);
+		for(unsigned char * cursor = memory+size; intact && cursor < (unsigned char*)guard; ++cursor){
+			intact = *cursor == MEM_GUARD_BYTE;
+		}
+		if(!intact){
+#ifdef MEM_LEAK_DEBUG
+			printf("\n%s\n\nmemory written past the end of %d bytes from #%d, %s:%d\n\n\n", failMessage,
+				(int)a_block->getSize(), (int)a_block->allocID, a_block->filename, (int)a_block->line);
+#else
+			printf("\n%s\n\nmemory written past the end of %d bytes at %p\n\n\n", failMessage,
+				(int)a_block->getSize(), memory);
 #endif
+			debugFailures++;
+		}
+		return intact;
+	}
+
+#ifdef MEM_LEAK_DEBUG
+	/** @return where a line of source's site is in the profile table, or the empty slot it would go in */
+	MEM::HeapSite * findSite(const char * a_filename, int a_line){
+		// file names are __FILE__ strings, so a site is known by its pointer and line
+		unsigned long long hash = ((unsigned long long)(ptrdiff_t)a_filename ^ ((unsigned long long)a_line << 40)) * 0x9e3779b97f4a7c15ull;
+		for(int index = (int)(hash >> 33); ; ++index){
+			MEM::HeapSite * site = &profileSites[index & (profileCapacity-1)];
+			if(!site->filename || (site->filename == a_filename && site->line == a_line)){
+				return site;
+			}
+		}
+	}
+	/** @return the profile's site for a line of source, added if it is new. 0 if the table could not grow */
+	MEM::HeapSite * profileSite(const char * a_filename, int a_line){
+		if(!a_filename){
+			a_filename = "unknown";
+		}
+		MEM::HeapSite * site = profileCapacity ? findSite(a_filename, a_line) : 0;
+		if(site && site->filename){
+			return site;
+		}
+		// the table is kept at most half full, so searches are short
+		if(profileCount*2 >= profileCapacity){
+			// malloc'd, since the table grows while operator new is running
+			const int capacity = profileCapacity ? profileCapacity*2 : 256;
+			MEM::HeapSite * sites = (MEM::HeapSite*)calloc(capacity, sizeof(MEM::HeapSite));
+			if(!sites){
+				return 0;
+			}
+			MEM::HeapSite * old = profileSites;
+			const int oldCapacity = profileCapacity;
+			profileSites = sites;
+			profileCapacity = capacity;
+			for(int i = 0; i < oldCapacity; ++i){
+				if(old[i].filename){
+					*findSite(old[i].filename, old[i].line) = old[i];
+				}
+			}
+			free(old);
+			site = findSite(a_filename, a_line);
+		}
+		site->filename = a_filename;
+		site->line = a_line;
+		profileCount++;
+		return site;
+	}
+	/** counts a block that was just allocated in the heap profile */
+	void profileAllocation(MemBlock * a_block){
+		MEM::HeapSite * site = profileSite(a_block->filename, (int)a_block->line);
+		if(!site){
+			// out of memory for the profile: stop, rather than count frees without their allocations
+			profiling = false;
+			return;
+		}
+		site->allocCount++;
+		site->allocBytes += a_block->getSize();
+	}
+	/** counts a block that is about to be freed in the heap profile, if the profile counted its allocation */
+	void profileFree(MemBlock * a_block){
+		if(a_block->allocID < profileStart){
+			return;
+		}
+		MEM::HeapSite * site = profileSite(a_block->filename, (int)a_block->line);
+		if(!site){
+			return;
+		}
+		site->freeCount++;
+		site->freeBytes += a_block->getSize();
+		// lifetimes are counted in allocation ids handed out since the block's own
+		int bucket = highestBit(numAllocations - a_block->allocID) / 2;
+		if(bucket >= MEM::HEAP_LIFETIME_BUCKETS){
+			bucket = MEM::HEAP_LIFETIME_BUCKETS-1;
+		}
+		site->lifetimes[bucket]++;
+	}
+	/** forgets the heap profile's counts. the lock must be held */
+	void resetProfile(){
+		if(profileSites){
+			memset(profileSites, 0, profileCapacity*sizeof(MEM::HeapSite));
+		}
+		profileCount = 0;
+		profileStart = numAllocations;
+		profileClock = clock();
+	}
+	/** copies up to a_capacity of the heap profile's sites. the lock must be held. @return how many sites there are */
+	int copyProfile(MEM::HeapSite * a_sites, int a_capacity){
+		int copied = 0;
+		for(int i = 0; i < profileCapacity && copied < a_capacity; ++i){
+			if(profileSites[i].filename){
+				a_sites[copied++] = profileSites[i];
+			}
+		}
+		return profileCount;
+	}
+	/**
+	 * @param a_count how many sites are in the copy
+	 * @param a_seconds how long the profile has been running, in processor time
+	 * @return a malloc'd copy of the heap profile, taken under the lock, so it can be written out without holding it
+	 */
+	MEM::HeapSite * snapshotProfile(int & a_count, double & a_seconds){
+#ifdef USE_CUSTOM_MEMORY_MANAGEMENT_THREADS
+		lock.lock();
+#endif
+		MEM::HeapSite * sites = (MEM::HeapSite*)malloc((profileCount ? profileCount : 1)*sizeof(MEM::HeapSite));
+		a_count = sites ? copyProfile(sites, profileCount) : 0;
+		a_seconds = (double)(clock() - profileClock) / CLOCKS_PER_SEC;
+#ifdef USE_CUSTOM_MEMORY_MANAGEMENT_THREADS
+		lock.unlock();
+#endif
+		return sites;
+	}
 #endif
+
+	/** @return how many usable bytes a block needs for num_bytes: size_t aligned, and big enough to hold free list links once it is freed */
+	static size_t usableSizeFor(size_t num_bytes){
+		size_t bytesNeeded = (num_bytes + MEM_ALIGNMENT-1) & ~(MEM_ALIGNMENT-1);
+		if(bytesNeeded < MEM_MIN_SIZE){
+			bytesNeeded = MEM_MIN_SIZE;
+		}
+		return bytesNeeded;
+	}
+
 	/**
 	 * will allocate memory from the memory system
 	 * @param num_bytes how many bytes are being asked for
 	 * @param filename/line where, in code, the memory is requested from, used if MEM_LEAK_DEBUG defined
+	 * @param a_guard whether to put a guard after the memory, see writeGuard
 	 */
-	void * allocate(size_t num_bytes, const char * filename, size_t line){
+	void * allocate(size_t num_bytes, const char * filename, size_t line, bool a_guard = false){
 MEM_DEBUG_INFRASTRUCTURE
 #ifdef MEM_LEAK_DEBUG
 		if(num_bytes > largestRequest){
@@ -280,248 +875,334 @@ MEM_DEBUG_INFRASTRUCTURE
 			numSmallRequests++;
 		}
 #endif
-		// allocated memory should be size_t aligned
-		size_t bytesNeeded = num_bytes;
-		if((bytesNeeded & ((signed)sizeof(ptrdiff_t)-1)) != 0){
-			bytesNeeded += (signed)sizeof(ptrdiff_t) - (num_bytes % sizeof(ptrdiff_t));
-		}
-		// which memory page is being searched
-		MemPage * page = mem;
-		// where this memory page ends
-		//int endOfThisPage;
-		// which memory block is being searched
-		MemBlock * block = 0;
-#ifdef MEM_LINKED_LIST
-		MemBlock ** prevNextPtr;
-#endif
-MEM_DEBUG_INFRASTRUCTURE
-	do{
-			// if there is no page
-			if(!page){
+		// a guard needs at least one word after the memory
+		const size_t bytesNeeded = usableSizeFor(a_guard ? num_bytes+sizeof(size_t) : num_bytes);
 MEM_DEBUG_INFRASTRUCTURE
-				// try to make one
-				page = addPageAtLeastBigEnoughFor(bytesNeeded);
-				// if there is _still_ no page
-MEM_DEBUG_INFRASTRUCTURE
-				if(!page){
-					// fail time.
-#ifdef VERIFY_INTEGRITY
+		MemBlock * block = takeFree(bytesNeeded);
+		if(!block){
+			// no free block is big enough: add a page that is
+			if(!addPageAtLeastBigEnoughFor(bytesNeeded)){
+				if(debugLevel != MEM::DEBUG_OFF){
 					verifyIntegrity("Allocation fail");
-#endif
-					return 0;
 				}
+				return 0;
 			}
-			// if no valid block is being checed at the moment
-			if(!block){
-#ifdef MEM_LINKED_LIST
-				prevNextPtr = &freeList;
-				block = freeList;
-#else
-				// memory will have to be traversed from the first block at the beginning of the page
-				block = page->firstBlock();
-				// keep track of where the page ends
-				endOfThisPage = endOfPage(page);
-#endif
-			}
-#ifndef MEM_LINKED_LIST
-			// check if the current memory block is free
-			if(block->isFree()){
-				// extended this free block as far as possible (till the block right after isn't free)
-				MemBlock * nextNode = block->nextContiguousBlock();
-				while((PTR_VAL)nextNode < endOfThisPage && nextNode->isFree()){
-#ifdef MEM_LEAK_DEBUG
-					if(nextNode->signature != MEM_LEAK_DEBUG){
-						// memory corruption... can't traverse as expected!
-						int i = 0; i = 1/i;
-					}
-#endif
-#ifdef MEM_CLEARED_HEADER
-					PTR_VAL* imem = (PTR_VAL*)nextNode;
-#endif
-					nextNode = nextNode->nextContiguousBlock();
-#ifdef MEM_CLEARED_HEADER
-					PTR_VAL numInts = sizeof(MemBlock)/sizeof(ptrdiff_t);
-					for(int i = 0; i < numInts; ++i){
-						imem[i]=MEM_CLEARED_HEADER;
-					}
-#endif
-				}
-				block->setSize(((PTR_VAL)nextNode-(PTR_VAL)block)-sizeof(MemBlock));
-#endif
+			block = takeFree(bytesNeeded);
+		}
 MEM_DEBUG_INFRASTRUCTURE
-				// if it has enough space to be spliced into 2 blocks
-				if(block->getSize() > bytesNeeded+sizeof(MemBlock))
-				{
-					// mark another free block where this one will end
-					MemBlock * next = block->nextContiguousHeader(bytesNeeded);
-					next->setSize(block->getSize() - (bytesNeeded+sizeof(MemBlock)));
-					next->markFree();
-#ifdef MEM_LINKED_LIST
-					next->next = block->next;
-#endif
+		// if it has enough space to be spliced into 2 blocks
+		if(block->getSize() >= bytesNeeded+sizeof(MemBlock)+MEM_MIN_SIZE){
+			// mark another free block where this one will end
+			MemBlock * next = block->nextContiguousHeader(bytesNeeded);
+			next->setSize(block->getSize() - (bytesNeeded+sizeof(MemBlock)));
+			next->markFree();
+			next->setPrevFree(false);
+			next->setLast(block->isLast());
+			next->setGuarded(false);
+			block->setLast(false);
 #ifdef MEM_LEAK_DEBUG
-					next->setupDebugInfo((char*)0x454C4946, 0x454E494C, numAllocations++);
-					//next->filename = (char*)0x454C4946;	// little-endian 'file'
-					//next->line = 0x454E494C;			// little-endian 'line'
-#endif
-					// and make this block exactly the size needed
-					block->setSize(bytesNeeded);
-#ifdef MEM_LINKED_LIST
-					// maintain free list integrity
-					block->next = next;
+			next->setupDebugInfo((char*)0x454C4946, 0x454E494C, numAllocations++);
+			//next->filename = (char*)0x454C4946;	// little-endian 'file'
+			//next->line = 0x454E494C;			// little-endian 'line'
 #endif
-				}
-MEM_DEBUG_INFRASTRUCTURE
-				// if the current block has enough space for this allocation
-				if(block->getSize() >= bytesNeeded){
-					// grab the section of memory that is being requested
-					void* allocatedMemory = block->allocatedMemory();
+			// and make this block exactly the size needed
+			block->setSize(bytesNeeded);
+			insertFree(next);
+		}else if(!block->isLast()){
+			block->nextContiguousBlock()->setPrevFree(false);
+		}
+		// mark it as allocated
+		block->markUsed();
+		block->next = 0;
+		block->setGuarded(false);
+		// grab the section of memory that is being requested
+		void* allocatedMemory = block->allocatedMemory();
 MEM_DEBUG_INFRASTRUCTURE
-#ifdef MEM_ALLOCATED
-					ptrdiff_t* imem = (ptrdiff_t*)allocatedMemory;
-					size_t numints = block->getSize()/sizeof(ptrdiff_t);
-					for(size_t i = 0; i < numints; ++i){
-						imem[i] = MEM_ALLOCATED;
-					}
+		if(debugLevel == MEM::DEBUG_FULL){
+			ptrdiff_t* imem = (ptrdiff_t*)allocatedMemory;
+			size_t numints = block->getSize()/sizeof(ptrdiff_t);
+			for(size_t i = 0; i < numints; ++i){
+				imem[i] = MEM_ALLOCATED;
+			}
 MEM_DEBUG_INFRASTRUCTURE
-#endif
+		}
+		if(a_guard){
+			writeGuard(block, num_bytes);
+		}
 #ifdef MEM_LEAK_DEBUG
-					block->setupDebugInfo(filename, line, numAllocations++);
-MEM_DEBUG_INFRASTRUCTURE
-#ifdef VERIFY_INTEGRITY
-					verifyIntegrity("allocation");
+		block->setupDebugInfo(filename, line, numAllocations++);
+		if(profiling){
+			profileAllocation(block);
+		}
 MEM_DEBUG_INFRASTRUCTURE
 #endif
-#endif
-					// mark it as allocated
-					block->markUsed();
+		sampleIntegrity("allocation");
 MEM_DEBUG_INFRASTRUCTURE
-#ifdef MEM_LINKED_LIST
-					// remove this mem block from the free list
-					*prevNextPtr = block->next;
-					// push this on the list
-					block->next = usedList;
-					usedList = block;
+		// return the memory!
+		return allocatedMemory;
+	}
+
+	/** marks a header that was merged into the block before it as cleared memory */
+	static void clearHeader(MemBlock * a_header){
+		ptrdiff_t* imem = (ptrdiff_t*)a_header;
+		size_t numInts = sizeof(MemBlock)/sizeof(ptrdiff_t);
+		for(size_t i = 0; i < numInts; ++i){
+			imem[i]=MEM_CLEARED_HEADER;
+		}
+	}
+
+	void deallocate(void * memory){
+		if(!memory){
+			return;
+		}
+		MemBlock * header = MemBlock::blockForAllocatedMemory(memory);//(MemBlock*)(((ptrdiff_t)memory)-sizeof(MemBlock));
+		if(header->isGuarded()){
+			checkGuard(header, "deallocation");
+			header->setGuarded(false);
+		}
+#ifdef MEM_LEAK_DEBUG
+		if(profiling){
+			profileFree(header);
+		}
 #endif
-MEM_DEBUG_INFRASTRUCTURE
-					// return the memory!
-					return allocatedMemory;
-				}
-MEM_DEBUG_INFRASTRUCTURE
-#ifndef MEM_LINKED_LIST
+		const bool clearing = debugLevel == MEM::DEBUG_FULL;
+		if(clearing){
+			ptrdiff_t* imem = (ptrdiff_t*)memory;
+			size_t numInts = header->getSize()/sizeof(ptrdiff_t);
+			for(size_t i = 0; i < numInts; ++i){
+				imem[i]=MEM_CLEARED;
 			}
-			// if the process is still going, memory has not been found yet.
-			// check the next block!
-			block = block->nextContiguousBlock();
-			// if the "next block" in this page is out of bounds
-			if((PTR_VAL)block >= endOfThisPage){
-				// go to the next page
-				page = page->next;
-				// start checking from the beginning
-				block = 0;
+		}
+		sampleIntegrity("deallocation");
+		header->markFree();
+		// merge the next block into this one, if it is free
+		if(!header->isLast()){
+			MemBlock * nextContBlock = header->nextContiguousBlock();
+			if(nextContBlock->isFree()){
+				removeFree(nextContBlock);
+				header->setSize(header->getSize()+sizeof(MemBlock)+nextContBlock->getSize());
+				header->setLast(nextContBlock->isLast());
+				if(clearing){
+					clearHeader(nextContBlock);
+				}
 			}
-#else
-			// if there are no more free blocks
-			if(!block->next){
-printf("allocating another page! %d\n", (int)bytesNeeded);
-				// add another free page, which will append a free block to this free list
-				addPageAtLeastBigEnoughFor(bytesNeeded);
+		}
+		// merge this block into the previous block, if it is free. its footer says where it starts
+		if(header->isPrevFree()){
+			MemBlock * prevContBlock = header->prevFreeBlock();
+			removeFree(prevContBlock);
+			prevContBlock->setSize(prevContBlock->getSize()+sizeof(MemBlock)+header->getSize());
+			prevContBlock->setLast(header->isLast());
+			if(clearing){
+				clearHeader(header);
 			}
-			// hold a reference to the reference that references the next memory block
-			prevNextPtr = &block->next;
-			// the next memory block is now the current memory block
-			block = block->next;
-#endif
-MEM_DEBUG_INFRASTRUCTURE
-		}while(true);	// while memory hasn't been found
-MEM_DEBUG_INFRASTRUCTURE
-		return 0;	// should never return here.
+			header = prevContBlock;
+		}
+		insertFree(header);
+		if(!header->isLast()){
+			header->nextContiguousBlock()->setPrevFree(true);
+		}
 	}
 
-	void deallocate(void * memory){
-		MemBlock * header = MemBlock::blockForAllocatedMemory(memory);//(MemBlock*)(((ptrdiff_t)memory)-sizeof(MemBlock));
-#ifdef MEM_CLEARED
-		ptrdiff_t* imem = (ptrdiff_t*)memory;
-		size_t numInts = header->getSize()/sizeof(ptrdiff_t);
-		for(size_t i = 0; i < numInts; ++i){
-			imem[i]=MEM_CLEARED;
+#ifdef MEM_THREAD_CACHE
+	/** @return a cache for a thread that has none: one whose thread ended, or a new one */
+	MemThreadCache * adoptCache(){
+		lock.lock();
+		MemThreadCache * cache = caches;
+		while(cache && cache->inUse){
+			cache = cache->nextCache;
 		}
+		if(!cache){
+			// caches are malloc'd, since they are made while operator new is running
+			cache = (MemThreadCache*)malloc(sizeof(MemThreadCache));
+			if(!cache){
+				int i=0;i=1/i;
+			}
+			new (cache) MemThreadCache();
+			cache->nextCache = caches;
+			caches = cache;
+		}
+		cache->inUse = true;
+		lock.unlock();
+		return cache;
+	}
+	/** gives every block in a cache back to the shared heap. the lock must be held */
+	void emptyCache(MemThreadCache * a_cache){
+		for(size_t i = 0; i < MEM_SMALL_BINS; ++i){
+			MemBlock * block = a_cache->bins[i].blocks;
+			while(block){
+				MemBlock * next = block->next;
+				deallocate(block->allocatedMemory());
+				block = next;
+			}
+			a_cache->bins[i].blocks = 0;
+			a_cache->bins[i].count = 0;
+		}
+		MemBlock * block = a_cache->remoteFrees.exchange(0, std::memory_order_acquire);
+		while(block){
+			MemBlock * next = MemThreadCache::nextRemoteFree(block);
+			deallocate(block->allocatedMemory());
+			block = next;
+		}
+	}
+	/** empties a cache whose thread is ending, so another thread can adopt it */
+	void retireCache(MemThreadCache * a_cache){
+		lock.lock();
+		emptyCache(a_cache);
+		a_cache->inUse = false;
+		lock.unlock();
+	}
+	/** gives half of a full bin back to the shared heap, under one lock */
+	void flushCache(MemCacheBin * a_bin){
+		lock.lock();
+		while(a_bin->count > MEM_CACHE_LIMIT/2){
+			MemBlock * block = a_bin->blocks;
+			a_bin->blocks = block->next;
+			a_bin->count--;
+			deallocate(block->allocatedMemory());
+		}
+		lock.unlock();
+	}
+	/** puts a block back into the bin it came from. only the bin's own thread calls this */
+	void cacheBlock(MemCacheBin * a_bin, MemBlock * a_block){
+		a_block->next = a_bin->blocks;
+		a_bin->blocks = a_block;
+		if(++a_bin->count > MEM_CACHE_LIMIT){
+			flushCache(a_bin);
+		}
+	}
+	/** takes back, all at once, the blocks other threads freed into a_cache */
+	void takeRemoteFrees(MemThreadCache * a_cache){
+		MemBlock * block = a_cache->remoteFrees.exchange(0, std::memory_order_acquire);
+		while(block){
+			MemBlock * next = MemThreadCache::nextRemoteFree(block);
+			cacheBlock((MemCacheBin*)block->next, block);
+			block = next;
+		}
+	}
+	/** fills a_cache's bin of a_size (a usableSizeFor) with blocks from the shared heap, under one lock */
+	void refillCache(MemThreadCache * a_cache, const size_t a_size, const char * filename, size_t line){
+		lock.lock();
+		for(int i = 0; i < MEM_CACHE_BATCH; ++i){
+			void * memory = allocate(a_size, filename, line);
+			if(!memory){
+				break;
+			}
+			MemBlock * block = MemBlock::blockForAllocatedMemory(memory);
+			if(block->getSize() >= MEM_SMALL_LIMIT){
+				// a block too small to split can be too big to cache
+				deallocate(memory);
+				break;
+			}
+			MemCacheBin * bin = &a_cache->bins[block->getSize() / MEM_ALIGNMENT];
+			block->next = bin->blocks;
+			bin->blocks = block;
+			bin->count++;
+		}
+		lock.unlock();
+	}
+	/** @return the calling thread's cache, 0 if the thread has ended */
+	MemThreadCache * threadCache(){
+		if(!t_cache && !t_cacheRetired){
+			t_cache = adoptCache();
+			// makes sure the thread retires its cache when it ends
+			(void)&t_cacheRetirer;
+		}
+		return t_cache;
+	}
 #endif
-#ifdef VERIFY_INTEGRITY
-		verifyIntegrity("deallocation");
-#endif
-		header->markFree();
-#ifdef MEM_LINKED_LIST
-		// used memory is not being listed. only free memory is important.
-		// if it becomes important to keep track of used memory, the MemBlock should be a double linked list.
-		//// remove this mem block from it's current list (not managing used memory)
-		//{
-		//	MemBlock ** p = &freeList;
-		//	while((*p)->next != header){
-		//		p = &(p->next);
-		//	}
-		//	*p = header->next;
-		//	header->next = 0;
-		//}
-// all of this code is used to merge a singly-linked list of memory blocks when they are contiguous... sheesh.
-		bool merged = false;
-		// what mem block would go right after this?
-		MemBlock * nextContBlock = header->nextContiguousBlock();
-		// this *might* be a valid free block... we'll find that out soon
-		MemBlock ** ptrToNextBlock = 0;
-		// traverse the entire free list
-		MemBlock * p = freeList;
-		// (we'll be inserting and removing, so keep a back-reference-reference)
-		MemBlock ** ptrToP = &freeList;
-		// which block will back-merge at the end
-		MemBlock * originBlock = header;
-		while(p){
-			// if the currently found mem block header is the expected next block
-			if(p == nextContBlock){
-				// then the next block is a free block, and it can be merged (done at the end)
-				ptrToNextBlock = ptrToP;
+
+	/** allocate for any thread: from its cache, or from the shared heap under the lock */
+	void * allocateForThread(size_t num_bytes, const char * filename, size_t line){
+		// guarded allocations come from the shared heap, which checks them when they are freed
+		const int level = debugLevel;
+		bool guard = level == MEM::DEBUG_FULL;
+		if(level == MEM::DEBUG_SAMPLED){
+			const int rate = sampleRate;
+			// a countdown from an older, slower rate starts over
+			if(--t_guardCountdown <= 0 || t_guardCountdown > rate){
+				t_guardCountdown = rate;
+				guard = true;
 			}
-			// if this current block should merge with the currently free-ing block
-			if(!merged){
-				MemBlock * tempNextContBlock = p->nextContiguousBlock();
-				if(tempNextContBlock == header){
-	//				// put this block's next as the newly free'd block's next
-	//				header->next = p->next;
-					// extend this block over the newly free'd block
-					p->setSize(p->getSize()+sizeof(MemBlock)+header->getSize());
-					originBlock = p;
-					merged = true;
+		}
+#ifdef MEM_THREAD_CACHE
+		const size_t bytesNeeded = usableSizeFor(num_bytes);
+		MemThreadCache * cache = (bytesNeeded < MEM_SMALL_LIMIT && !guard) ? threadCache() : 0;
+		if(cache){
+			MemCacheBin * bin = &cache->bins[bytesNeeded / MEM_ALIGNMENT];
+			if(!bin->blocks){
+				takeRemoteFrees(cache);
+				if(!bin->blocks){
+					refillCache(cache, bytesNeeded, filename, line);
 				}
 			}
-			// go to the next free block
-			ptrToP = &p->next;
-			p = p->next;
-		}
-		// if this memory can merge with the next block
-		if(ptrToNextBlock){
-			// remove the next mem block from the old list
-			if(merged){
-				// if it was merged earlier, just reference the next guy.
-				*ptrToNextBlock = nextContBlock->next;
-			}else{
-				// if it wasn't merged, merge it into the list now
-				*ptrToNextBlock = originBlock;
-				originBlock->next = nextContBlock->next;
+			MemBlock * block = bin->blocks;
+			if(block){
+				bin->blocks = block->next;
+				bin->count--;
+				block->next = (MemBlock*)bin;
+				return block->allocatedMemory();
 			}
-			// forward merge the next mem block from the previous mem block
-			originBlock->setSize(originBlock->getSize()+sizeof(MemBlock)+nextContBlock->getSize());
-			merged = true;
 		}
-		// if this mem block could not be merged into an existing mem block
-		if(!merged){
-			// push it on the list.
-			header->next = freeList;
-			freeList = header;	// push it real good.
+#endif
+#ifdef USE_CUSTOM_MEMORY_MANAGEMENT_THREADS
+		lock.lock();
+		void * result = allocate(num_bytes, filename, line, guard);
+		lock.unlock();
+		return result;
+#else
+		return allocate(num_bytes, filename, line, guard);
+#endif
+	}
+
+	/** deallocate for any thread: a cached block goes back to the cache it came from, anything else to the shared heap */
+	void deallocateForThread(void * memory){
+#ifdef MEM_THREAD_CACHE
+		if(!memory){
+			return;
+		}
+		MemBlock * header = MemBlock::blockForAllocatedMemory(memory);
+		MemCacheBin * bin = (MemCacheBin*)header->next;
+		if(bin && debugLevel == MEM::DEBUG_FULL){
+			// the shared heap clears and checks everything freed at this level
+			bin = 0;
+		}
+		if(bin && bin->cache == t_cache){
+			cacheBlock(bin, header);
+			return;
+		}
+		if(bin){
+			// another thread's block: it takes it back with the rest of its remote frees
+			MemThreadCache * owner = bin->cache;
+			MemBlock * head = owner->remoteFrees.load(std::memory_order_relaxed);
+			do{
+				MemThreadCache::nextRemoteFree(header) = head;
+			}while(!owner->remoteFrees.compare_exchange_weak(head, header, std::memory_order_release, std::memory_order_relaxed));
+			return;
 		}
+#endif
+#ifdef USE_CUSTOM_MEMORY_MANAGEMENT_THREADS
+		lock.lock();
+		deallocate(memory);
+		lock.unlock();
+#else
+		deallocate(memory);
 #endif
 	}
 
 	void reportMemory(){
+#ifdef USE_CUSTOM_MEMORY_MANAGEMENT_THREADS
+		lock.lock();
+#endif
+#ifdef MEM_THREAD_CACHE
+		// the calling thread's cached blocks are not in use, and neither are blocks freed into
+		// the caches of threads that ended. other threads' caches are counted as used
+		for(MemThreadCache * cache = caches; cache; cache = cache->nextCache){
+			if(cache == t_cache || !cache->inUse){
+				emptyCache(cache);
+			}
+		}
+#endif
 		MemPage * current = mem;
 		if(current){
 			int pages = 0;
@@ -561,11 +1242,17 @@ MEM_DEBUG_INFRASTRUCTURE
 		}else{
 			printf("memory clean\n");
 		}
+#ifdef USE_CUSTOM_MEMORY_MANAGEMENT_THREADS
+		lock.unlock();
+#endif
 	}
 
 	int release(){
 #ifdef MEM_LEAK_DEBUG
 		int leaks = 0;
+#endif
+#ifdef USE_CUSTOM_MEMORY_MANAGEMENT_THREADS
+		lock.lock();
 #endif
 		if(mem){
 			MemPage * next;
@@ -597,17 +1284,58 @@ MEM_DEBUG_INFRASTRUCTURE
 #endif
 		}
 		mem = 0;
+		clearFreeIndex();
+#ifdef MEM_LEAK_DEBUG
+		// every block the profile counted is gone
+		resetProfile();
+#endif
+#ifdef MEM_THREAD_CACHE
+		// cached blocks were in the pages that were just freed
+		for(MemThreadCache * cache = caches; cache; cache = cache->nextCache){
+			for(size_t i = 0; i < MEM_SMALL_BINS; ++i){
+				cache->bins[i].blocks = 0;
+				cache->bins[i].count = 0;
+			}
+			cache->remoteFrees.store(0, std::memory_order_relaxed);
+		}
+#endif
+#ifdef USE_CUSTOM_MEMORY_MANAGEMENT_THREADS
+		lock.unlock();
+#endif
 #ifdef MEM_LEAK_DEBUG
 		return leaks;
 #else
 		return 0;
 #endif
 	}
-	~MemManager(){release();}
+	~MemManager(){
+		release();
+#ifdef MEM_LEAK_DEBUG
+		free(profileSites);
+#endif
+#ifdef MEM_THREAD_CACHE
+		while(caches){
+			MemThreadCache * next = caches->nextCache;
+			caches->~MemThreadCache();
+			free(caches);
+			caches = next;
+		}
+#endif
+	}
 };
 
 MemManager memory;
 
+#ifdef MEM_THREAD_CACHE
+MemThreadCacheRetirer::~MemThreadCacheRetirer(){
+	if(t_cache){
+		memory.retireCache(t_cache);
+		t_cache = 0;
+	}
+	t_cacheRetired = true;
+}
+#endif
+
 static ptrdiff_t g_stackbegin, g_stackend;
 /**
  * @param ptr where to mark the stack as starting
@@ -622,23 +1350,181 @@ void MEM::markAsStack(void * ptr, size_t stackSize)
 /** @return how many bytes expected to be valid beyond this memory address */
 size_t MEM::validBytesAt(void * ptr)
 {
-	MemPage * cursor = memory.mem;
 	ptrdiff_t start = g_stackbegin, end = g_stackend, thisone = (ptrdiff_t)ptr;
 	if(thisone >= start && thisone < end){
 		return end-thisone;
 	}
+	size_t validBytes = 0;
+#ifdef USE_CUSTOM_MEMORY_MANAGEMENT_THREADS
+	memory.lock.lock();
+#endif
+	MemPage * cursor = memory.mem;
 	while(cursor)
 	{
 		start = (ptrdiff_t)cursor;
 		end = start+cursor->size;
 		if(thisone >= start && thisone < end){
-			return end-thisone;
+			validBytes = end-thisone;
+			break;
 		}
 		cursor = cursor->next;
 	}
+#ifdef USE_CUSTOM_MEMORY_MANAGEMENT_THREADS
+	memory.lock.unlock();
+#endif
+	return validBytes;
+}
+
+
+void MEM::setDebugLevel(DebugLevel a_level, int a_sampleRate)
+{
+	memory.sampleRate = (a_sampleRate < 1) ? 1 : a_sampleRate;
+	memory.debugLevel = a_level;
+}
+
+MEM::DebugLevel MEM::getDebugLevel()
+{
+	return (DebugLevel)(int)memory.debugLevel;
+}
+
+int MEM::getDebugFailures()
+{
+#ifdef USE_CUSTOM_MEMORY_MANAGEMENT_THREADS
+	memory.lock.lock();
+#endif
+	int failures = memory.debugFailures;
+#ifdef USE_CUSTOM_MEMORY_MANAGEMENT_THREADS
+	memory.lock.unlock();
+#endif
+	return failures;
+}
+
+bool MEM::startHeapProfile()
+{
+#ifdef MEM_LEAK_DEBUG
+#ifdef USE_CUSTOM_MEMORY_MANAGEMENT_THREADS
+	memory.lock.lock();
+#endif
+	memory.resetProfile();
+	memory.profiling = true;
+#ifdef USE_CUSTOM_MEMORY_MANAGEMENT_THREADS
+	memory.lock.unlock();
+#endif
+	return true;
+#else
+	return false;
+#endif
+}
+
+void MEM::stopHeapProfile()
+{
+#ifdef MEM_LEAK_DEBUG
+#ifdef USE_CUSTOM_MEMORY_MANAGEMENT_THREADS
+	memory.lock.lock();
+#endif
+	memory.profiling = false;
+#ifdef USE_CUSTOM_MEMORY_MANAGEMENT_THREADS
+	memory.lock.unlock();
+#endif
+#endif
+}
+
+int MEM::getHeapProfile(HeapSite * a_sites, int a_capacity)
+{
+	int count = 0;
+#ifdef MEM_LEAK_DEBUG
+#ifdef USE_CUSTOM_MEMORY_MANAGEMENT_THREADS
+	memory.lock.lock();
+#endif
+	count = memory.copyProfile(a_sites, a_capacity);
+#ifdef USE_CUSTOM_MEMORY_MANAGEMENT_THREADS
+	memory.lock.unlock();
+#endif
+#endif
+	return count;
+}
+
+#ifdef MEM_LEAK_DEBUG
+/** the value a heap profile file gives for a site */
+static size_t heapProfileValue(MEM::HeapSite const & a_site, MEM::HeapProfileValue a_value)
+{
+	switch(a_value){
+	case MEM::HEAP_LIVE_BYTES:	return a_site.liveBytes();
+	case MEM::HEAP_LIVE_COUNT:	return a_site.liveCount();
+	case MEM::HEAP_ALLOC_BYTES:	return a_site.allocBytes;
+	case MEM::HEAP_ALLOC_COUNT:	return a_site.allocCount;
+	}
 	return 0;
 }
+/** for qsort: the sites with the most live bytes first */
+static int compareLiveBytes(const void * a, const void * b)
+{
+	size_t liveA = ((MEM::HeapSite const *)a)->liveBytes(), liveB = ((MEM::HeapSite const *)b)->liveBytes();
+	return (liveA > liveB) ? -1 : ((liveA < liveB) ? 1 : 0);
+}
+#endif
+
+bool MEM::writeHeapProfile(const char * a_filename, HeapProfileValue a_value)
+{
+#ifdef MEM_LEAK_DEBUG
+	int count;
+	double seconds;
+	HeapSite * sites = memory.snapshotProfile(count, seconds);
+	FILE * file = sites ? fopen(a_filename, "w") : 0;
+	bool ok = file != 0;
+	for(int i = 0; ok && i < count; ++i){
+		size_t value = heapProfileValue(sites[i], a_value);
+		if(value){
+			ok = fprintf(file, "%s;%s:%d %llu\n", sites[i].filename, sites[i].filename, sites[i].line,
+				(unsigned long long)value) > 0;
+		}
+	}
+	if(file){
+		ok = (fclose(file) == 0) && ok;
+	}
+	free(sites);
+	return ok;
+#else
+	return false;
+#endif
+}
 
+void MEM::reportHeapProfile()
+{
+#ifdef MEM_LEAK_DEBUG
+	int count;
+	double seconds;
+	HeapSite * sites = memory.snapshotProfile(count, seconds);
+	if(!sites){
+		return;
+	}
+	qsort(sites, count, sizeof(HeapSite), compareLiveBytes);
+	printf("heap profile: %d sites, %.2f seconds (bytes are block bytes: aligned, with guards)\n", count, seconds);
+	printf("  live bytes  blocks  alloc bytes   allocs  alloc KB/s  site\n");
+	for(int i = 0; i < count; ++i){
+		HeapSite & site = sites[i];
+		printf("%12llu %7llu %12llu %8llu %11.1f  %s:%d\n",
+			(unsigned long long)site.liveBytes(), (unsigned long long)site.liveCount(),
+			(unsigned long long)site.allocBytes, (unsigned long long)site.allocCount,
+			(seconds > 0) ? site.allocBytes/1024.0/seconds : 0.0, site.filename, site.line);
+		int buckets = HEAP_LIFETIME_BUCKETS;
+		while(buckets > 0 && !site.lifetimes[buckets-1]){
+			buckets--;
+		}
+		if(buckets){
+			// bucket i counts frees after 4^i up to 4^(i+1) allocations
+			printf("              freed after <4, <16, <64... allocations:");
+			for(int b = 0; b < buckets; ++b){
+				printf(" %llu", (unsigned long long)site.lifetimes[b]);
+			}
+			printf("\n");
+		}
+	}
+	free(sites);
+#else
+	printf("no heap profile without MEM_LEAK_DEBUG\n");
+#endif
+}
 
 int MEM::RELEASE_MEMORY(){
 	return memory.release();
@@ -649,8 +1535,8 @@ void MEM::REPORT_MEMORY(){
 }
 
 /** overrides where the source of memory allocation should be documented as */
-const char* __NEWMEM_FILE_NAME=0;
-int __NEWMEM_FILE_LINE=0;
+MEM_THREAD_LOCAL const char* __NEWMEM_FILE_NAME=0;
+MEM_THREAD_LOCAL int __NEWMEM_FILE_LINE=0;
 
 void* operator new( size_t num_bytes, const char * filename, int line) __NEWTHROW
 {
@@ -662,7 +1548,7 @@ void* operator new( size_t num_bytes, const char * filename, int line) __NEWTHRO
 	__NEWMEM_FILE_LINE=0;
 //	printf("alloc %10d   %s:%d\n", num_bytes, filename, line);
 MEM_DEBUG_INFRASTRUCTURE
-	void * resultMemory = memory.allocate(num_bytes, filename, line);
+	void * resultMemory = memory.allocateForThread(num_bytes, filename, line);
 MEM_DEBUG_INFRASTRUCTURE
 	return resultMemory;
 }
@@ -683,7 +1569,7 @@ void* operator new[]( size_t num_bytes, const char * filename, int line) __NEWTH
 
 void operator delete(void* data, const char * filename, int line) throw()
 {
-	return memory.deallocate(data);
+	return memory.deallocateForThread(data);
 }
 void operator delete[](void* data, const char * filename, int line) throw()
 {
@@ -692,7 +1578,7 @@ void operator delete[](void* data, const char * filename, int line) throw()
 
 void operator delete(void* data) throw()
 {
-	return memory.deallocate(data);
+	return memory.deallocateForThread(data);
 }
 void operator delete[](void* data) throw()
 {
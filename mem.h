@@ -22,6 +22,13 @@
 /** defined if the custom memory manager should be using debug infrastructure */
 #define USE_CUSTOM_MEMORY_MANAGEMENT_DEBUG
 
+/**
+ * defined if the custom memory manager should be safe to use from many
+ * threads. needs C++11. each thread caches small blocks, so most calls
+ * don't take the heap's lock (debug builds lock every call)
+ */
+#define USE_CUSTOM_MEMORY_MANAGEMENT_THREADS
+
 #include <new>		// to redefine new
 
 #ifdef _WIN32
@@ -58,30 +65,48 @@
 #ifdef ENVIRONMENT64
 /** turns on memory debugging. enables memory leak test output. increases memory header size! */
 #define MEM_LEAK_DEBUG		0x9d9285848185889b	// [HEADER]	0x5d5245444145485b
+#elif defined ENVIRONMENT32
+/** turns on memory debugging. enables memory leak test output. increases memory header size! */
+#define MEM_LEAK_DEBUG		0x84818588	// HEAD
+#endif
+#endif
+
+// the patterns below are written at MEM::DEBUG_FULL (and guards at MEM::DEBUG_SAMPLED too)
+#ifdef ENVIRONMENT64
 /** clears allocated memory with this character (when enabled) */
 #define MEM_ALLOCATED		0x9d8d858d97858e9b	// [NEWMEM]	0x5d4d454d57454e5b
 /** clears deallocated memory (that was once a header) with this character (when enabled) */
 #define MEM_CLEARED_HEADER	0xfddfd4d1d5d8dffb	// [_HEAD_]	0x5d485241454c435b
 /** clears deallocated memory with this character (when enabled) */
 #define MEM_CLEARED			0xfddfdfdfdfdfdffb	// [CLEARM]	0x5d4d5241454c435b
+/** marks the end of a guarded allocation, xor'd with how many bytes were asked for */
+#define MEM_GUARD			0x9d9f84928195879b	// [GUARD_]	0x5d5f44524155475b
 #elif defined ENVIRONMENT32
-/** turns on memory debugging. enables memory leak test output. increases memory header size! */
-#define MEM_LEAK_DEBUG		0x84818588	// HEAD
 /** clears allocated memory with this character (when enabled) */
 #define MEM_ALLOCATED		0xcdd7c5ce	// NEWM
 /** clears deallocated memory (that was once a header) with this character (when enabled) */
 #define MEM_CLEARED_HEADER	0xfdd3d8fb	// [HD]
 /** clears deallocated memory with this character (when enabled) */
 #define MEM_CLEARED			0xfddfdffb	// [__]
+/** marks the end of a guarded allocation, xor'd with how many bytes were asked for */
+#define MEM_GUARD			0x84928187	// GARD
 #endif
-#endif
+/** fills the unused bytes at the end of a guarded allocation */
+#define MEM_GUARD_BYTE		0xfd
 
-extern const char* __NEWMEM_FILE_NAME;
-extern int __NEWMEM_FILE_LINE;
+#ifdef USE_CUSTOM_MEMORY_MANAGEMENT_THREADS
+/** each thread traces its own allocation sources */
+#define MEM_THREAD_LOCAL	thread_local
+#else
+#define MEM_THREAD_LOCAL
+#endif
+extern MEM_THREAD_LOCAL const char* __NEWMEM_FILE_NAME;
+extern MEM_THREAD_LOCAL int __NEWMEM_FILE_LINE;
 
 #define	NEWMEM_SOURCE_DELEGATED	{if(!__NEWMEM_FILE_NAME){__NEWMEM_FILE_NAME=__FILE__;__NEWMEM_FILE_LINE=__LINE__;}}
 #define	NEWMEM_SOURCE_DELEGATED_CLEAR	{__NEWMEM_FILE_NAME=0;}
-#define NEWMEM_SOURCE_TRACE(EXPRESSION)	{const char*__f=__NEWMEM_FILE_NAME;int __l=__NEWMEM_FILE_LINE;if(!__NEWMEM_FILE_NAME){__NEWMEM_FILE_NAME=const_cast<char*>(__FILE__);__NEWMEM_FILE_LINE=__LINE__;}	EXPRESSION;		if(!__NEWMEM_FILE_NAME){__NEWMEM_FILE_NAME=__f;__NEWMEM_FILE_LINE=__l;}}
+// the source is put back even if EXPRESSION allocated nothing, so it is not blamed for the next allocation
+#define NEWMEM_SOURCE_TRACE(EXPRESSION)	{const char*__f=__NEWMEM_FILE_NAME;int __l=__NEWMEM_FILE_LINE;if(!__NEWMEM_FILE_NAME){__NEWMEM_FILE_NAME=const_cast<char*>(__FILE__);__NEWMEM_FILE_LINE=__LINE__;}	EXPRESSION;		__NEWMEM_FILE_NAME=__f;__NEWMEM_FILE_LINE=__l;}
 
 #	define NEWMEM(T)	new (const_cast<char*>(__FILE__), __LINE__) T
 #	define NEWMEM_ARR(T, COUNT)	new (const_cast<char*>(__FILE__), __LINE__) T[COUNT]
@@ -90,6 +115,94 @@ extern int __NEWMEM_FILE_LINE;
 
 namespace MEM
 {
+	/** how much checking the custom memory manager does. see setDebugLevel */
+	enum DebugLevel {
+		/** no checking */
+		DEBUG_OFF,
+		/**
+		 * low overhead checking, to leave on in production: 1 in N calls checks
+		 * the whole heap, and 1 in N allocations has a guard after it, which is
+		 * checked when it is freed
+		 */
+		DEBUG_SAMPLED,
+		/** every call checks the whole heap, every allocation is guarded, and memory is filled with patterns */
+		DEBUG_FULL
+	};
+
+	/**
+	 * @param a_level how much checking to do from now on. starts at DEBUG_FULL
+	 * with USE_CUSTOM_MEMORY_MANAGEMENT_DEBUG, DEBUG_OFF without
+	 * @param a_sampleRate the N of DEBUG_SAMPLED
+	 */
+	void setDebugLevel(DebugLevel a_level, int a_sampleRate = 1024);
+
+	/** @return how much checking the custom memory manager does */
+	DebugLevel getDebugLevel();
+
+	/** @return how many corruptions the checks have found */
+	int getDebugFailures();
+
+	/** how many buckets a HeapSite's lifetime histogram has */
+	static const int HEAP_LIFETIME_BUCKETS = 16;
+
+	/** what a heap profile knows about one line of source that allocates memory */
+	struct HeapSite {
+		/** the NEWMEM (or NEWMEM_SOURCE_TRACE) that asked for the memory */
+		const char * filename;
+		int line;
+		/**
+		 * every allocation and free since the profile started. bytes are the
+		 * heap blocks the memory took, not the bytes asked for: they include
+		 * alignment, the minimum block size, and, when guarded, the guard
+		 */
+		size_t allocCount, allocBytes, freeCount, freeBytes;
+		/**
+		 * freed blocks, by how many allocations were made while they lived:
+		 * bucket i counts lifetimes from 4^i up to 4^(i+1), the last bucket
+		 * counts all of the longer ones
+		 */
+		size_t lifetimes[HEAP_LIFETIME_BUCKETS];
+		/** @return how many allocations from here are still in use */
+		inline size_t liveCount() const { return allocCount - freeCount; }
+		/** @return how many bytes from here are still in use */
+		inline size_t liveBytes() const { return allocBytes - freeBytes; }
+	};
+
+	/** which number a heap profile file gives for each site */
+	enum HeapProfileValue { HEAP_LIVE_BYTES, HEAP_LIVE_COUNT, HEAP_ALLOC_BYTES, HEAP_ALLOC_COUNT };
+
+	/**
+	 * starts a heap profile: from now on, every allocation and free is
+	 * counted by the source line that asked for the memory. forgets any
+	 * earlier profile. memory allocated before the start is not counted
+	 * @return false if the profile can't be kept: the source lines come from
+	 * MEM_LEAK_DEBUG's block headers, so it needs USE_CUSTOM_MEMORY_MANAGEMENT_DEBUG
+	 */
+	bool startHeapProfile();
+
+	/** stops counting. the profile is kept until the next startHeapProfile */
+	void stopHeapProfile();
+
+	/**
+	 * copies the profile, one HeapSite per source line, in no particular order
+	 * @return how many sites the profile has, which may be more than a_capacity
+	 */
+	int getHeapProfile(HeapSite * a_sites, int a_capacity);
+
+	/**
+	 * writes the profile in the collapsed stack format of flamegraph.pl
+	 * (which speedscope and other flame graph viewers also read): a line of
+	 * "file;file:line value" for each site, so sites are grouped by file
+	 * @return false if the file could not be written
+	 */
+	bool writeHeapProfile(const char * a_filename, HeapProfileValue a_value = HEAP_LIVE_BYTES);
+
+	/**
+	 * prints the profile, the sites with the most live bytes first. bytes
+	 * are block bytes, as in HeapSite, so they include alignment and guards
+	 */
+	void reportHeapProfile();
+
 	/** @return how many bytes expected to be valid beyond this memory address */
 	size_t validBytesAt(void * ptr);
 
@@ -135,6 +248,31 @@ namespace MEM
 
 namespace MEM
 {
+	enum DebugLevel { DEBUG_OFF, DEBUG_SAMPLED, DEBUG_FULL };
+
+	/** the standard allocator does no checking */
+	inline void setDebugLevel(DebugLevel a_level, int a_sampleRate = 1024){}
+	inline DebugLevel getDebugLevel(){return DEBUG_OFF;}
+	inline int getDebugFailures(){return 0;}
+
+	static const int HEAP_LIFETIME_BUCKETS = 16;
+	struct HeapSite {
+		const char * filename;
+		int line;
+		size_t allocCount, allocBytes, freeCount, freeBytes;
+		size_t lifetimes[HEAP_LIFETIME_BUCKETS];
+		inline size_t liveCount() const { return allocCount - freeCount; }
+		inline size_t liveBytes() const { return allocBytes - freeBytes; }
+	};
+	enum HeapProfileValue { HEAP_LIVE_BYTES, HEAP_LIVE_COUNT, HEAP_ALLOC_BYTES, HEAP_ALLOC_COUNT };
+
+	/** the standard allocator does not know where memory was asked for, so there is no heap profile */
+	inline bool startHeapProfile(){return false;}
+	inline void stopHeapProfile(){}
+	inline int getHeapProfile(HeapSite * a_sites, int a_capacity){return 0;}
+	inline bool writeHeapProfile(const char * a_filename, HeapProfileValue a_value = HEAP_LIVE_BYTES){return false;}
+	inline void reportHeapProfile(){}
+
 	/** @return does not return the number of memory leaks */
 	inline int RELEASE_MEMORY(){return 0;}
 
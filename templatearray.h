@@ -10,6 +10,9 @@
 #define CPP11_HAS_MOVE_SEMANTICS
 #define CPP11_HAS_LAMBDA_SEMANTICS
 #define CPP11_HAS_INITIALIZER_LIST
+#define CPP11_HAS_TYPE_TRAITS
+#define CPP11_HAS_VARIADIC_TEMPLATES
+#define CPP11_HAS_THREADS
 /*
 If programming in Eclipse CDT (Juno), do the following for C++11
 [Properties]->[C/C++ Build]->[Settings]->[Tool Settings](tab)
@@ -29,18 +32,54 @@ If programming in Eclipse CDT (Juno), do the following for C++11
 #include <initializer_list>
 #endif
 
+#ifdef CPP11_HAS_TYPE_TRAITS
+#include <type_traits>
+#endif
+
+#ifdef CPP11_HAS_MOVE_SEMANTICS
+#include <utility>	// std::move
+#endif
+
+#include <string.h>	// memcpy, memmove
+#include <new>		// placement new
+
 #include "mem.h"
+#include "templatesort.h"
+#include "templatesearch.h"
+#include "templatescan.h"
+#ifdef CPP11_HAS_THREADS
+#include "templatesortparallel.h"
+#endif
 
 /**
- * using malloc will not require a default constructor for the component type.
- * However, it will also fail to call a constructor, destructor, and fail to
- * initialize any virtual tables.
+ * element memory is always raw memory, and elements are constructed in place.
+ * this picks malloc/realloc/free instead of NEWMEM_ARR/DELMEM_ARR for that
+ * raw memory, which lets bitwise-copyable types grow in place, but hides the
+ * memory from the custom memory manager.
  */
 //#define TEMPLATEARRAY_USES_MALLOC
 
+/**
+ * if true, DATA_TYPE can be copied around in memory with memcpy instead of
+ * operator=, one element at a time. Specialize this for types that are safe
+ * to copy bitwise, but do not count as trivially copyable to the compiler.
+ */
+template<typename DATA_TYPE>
+struct TemplateArrayIsBitwiseCopyable
+{
+#ifdef CPP11_HAS_TYPE_TRAITS
+	static const bool value = std::is_trivially_copyable<DATA_TYPE>::value;
+#else
+	static const bool value = false;
+#endif
+};
+
 /**
  * This data structure is ideal when the size is known at creation time, and
- * unlikely to change, though when it changes, it does so to large degrees
+ * unlikely to change, though when it changes, it does so to large degrees.
+ * Memory is kept raw: only elements in [0,size()) are constructed.
+ * add/insert/remove grow the memory geometrically and shrink it with
+ * hysteresis; allocateToSize, reserve and shrinkToFit set it explicitly.
  */
 template<typename DATA_TYPE>
 class TemplateArray
@@ -49,9 +88,227 @@ protected:
 	/** pointer to the allocated data for the vector */
 	DATA_TYPE * m_data;
 
-	/** actual number of allocated elements that we can use */
+	/** actual number of allocated elements that we can use (all constructed) */
 	int m_allocated;
 
+	/** how many elements m_data has memory for. only m_allocated are constructed */
+	int m_capacity;
+
+	/** @return uninitialized memory for a_count elements (no constructors are called) */
+	static inline DATA_TYPE * newRawMemory(const int a_count)
+	{
+#ifndef TEMPLATEARRAY_USES_MALLOC
+		return (DATA_TYPE *)NEWMEM_ARR(char, sizeof(DATA_TYPE)*a_count);
+#else
+		return (DATA_TYPE *)malloc(sizeof(DATA_TYPE)*a_count);
+#endif
+	}
+
+	/** @param a_memory from newRawMemory, to release without calling destructors */
+	static inline void deleteRawMemory(DATA_TYPE * a_memory)
+	{
+#ifndef TEMPLATEARRAY_USES_MALLOC
+		char * memory = (char *)a_memory;
+		DELMEM_ARR(memory);
+#else
+		free(a_memory);
+#endif
+	}
+
+	/** default-constructs a_count elements in the raw memory at a_memory */
+	static inline void constructElements(DATA_TYPE * a_memory, const int a_count)
+	{
+		for(int i = 0; i < a_count; ++i)
+		{
+			new (a_memory+i) DATA_TYPE;
+		}
+	}
+
+	/** copy-constructs a_count elements in the raw memory at a_memory */
+	static inline void constructElements(DATA_TYPE * a_memory, const int a_count, DATA_TYPE const & a_value)
+	{
+		for(int i = 0; i < a_count; ++i)
+		{
+			new (a_memory+i) DATA_TYPE(a_value);
+		}
+	}
+
+	/** copy-constructs a_count elements from a_source into the raw memory at a_dest */
+	static inline void copyElements(DATA_TYPE * a_dest, const DATA_TYPE * a_source, const int a_count)
+	{
+		if(a_count <= 0)
+			return;
+		if(TemplateArrayIsBitwiseCopyable<DATA_TYPE>::value)
+		{
+			memcpy((void*)a_dest, (const void*)a_source, sizeof(DATA_TYPE)*a_count);
+		}
+		else
+		{
+			for(int i = 0; i < a_count; ++i)
+			{
+				new (a_dest+i) DATA_TYPE(a_source[i]);
+			}
+		}
+	}
+
+	/** calls the destructor of a_count elements at a_memory, leaving raw memory */
+	static inline void destroyElements(DATA_TYPE * a_memory, const int a_count)
+	{
+		for(int i = 0; i < a_count; ++i)
+		{
+			a_memory[i].~DATA_TYPE();
+		}
+	}
+
+	/**
+	 * moves a_count elements from a_source into the raw memory at a_dest, which
+	 * must not overlap. a_source is left as raw memory. uses one memcpy for
+	 * bitwise-copyable types, and move construction for the rest.
+	 */
+	static inline void relocate(DATA_TYPE * a_dest, DATA_TYPE * a_source, const int a_count)
+	{
+		if(TemplateArrayIsBitwiseCopyable<DATA_TYPE>::value)
+		{
+			memcpy((void*)a_dest, (const void*)a_source, sizeof(DATA_TYPE)*a_count);
+		}
+		else
+		{
+			for(int i = 0; i < a_count; ++i)
+			{
+#ifdef CPP11_HAS_MOVE_SEMANTICS
+				new (a_dest+i) DATA_TYPE(std::move(a_source[i]));
+#else
+				new (a_dest+i) DATA_TYPE(a_source[i]);
+#endif
+				a_source[i].~DATA_TYPE();
+			}
+		}
+	}
+
+	/**
+	 * changes how much memory is allocated, keeping the constructed elements
+	 * @param a_capacity must be at least size()
+	 * @return false if the memory could not be allocated
+	 */
+	bool setCapacity(const int a_capacity)
+	{
+#ifdef TEST_OOB
+		if(a_capacity < m_allocated)
+		{
+			int i=0;i=1/i;
+		}
+#endif
+		if(a_capacity == m_capacity)
+			return true;
+		if(!a_capacity)
+		{
+			if(m_data)
+				deleteRawMemory(m_data);
+			m_data = 0;
+			m_capacity = 0;
+			return true;
+		}
+#ifdef TEMPLATEARRAY_USES_MALLOC
+		// realloc can grow in place, and copies bitwise when it can't
+		if(m_data && TemplateArrayIsBitwiseCopyable<DATA_TYPE>::value)
+		{
+			DATA_TYPE * grown = (DATA_TYPE *)realloc(m_data, sizeof(DATA_TYPE)*a_capacity);
+			if(!grown)	return false;
+			m_data = grown;
+			m_capacity = a_capacity;
+			return true;
+		}
+#endif
+		DATA_TYPE * newList = newRawMemory(a_capacity);
+		// if the list could not allocate, fail...
+		if(!newList)	return false;
+		if(m_data)
+		{
+			// fill the new list with the old data, in bulk if possible
+			relocate(newList, m_data, m_allocated);
+			// get rid of the old list (so we can maybe use the memory later)
+			deleteRawMemory(m_data);
+		}
+		m_data = newList;
+		m_capacity = a_capacity;
+		return true;
+	}
+
+	/** the default size to allocate new lists to, when they first grow */
+	static const int DEFAULT_ALLOCATION_SIZE = 8;
+
+	/**
+	 * makes sure there is memory for at least a_size elements, doubling the
+	 * allocation to avoid reallocating on every add
+	 */
+	bool growToFit(const int a_size)
+	{
+		if(a_size <= m_capacity)
+			return true;
+		int nextSize = m_capacity ? m_capacity*2 : DEFAULT_ALLOCATION_SIZE;
+		if(nextSize < a_size)
+			nextSize = a_size;
+		return setCapacity(nextSize);
+	}
+
+	/**
+	 * halves the allocation once the list is only a quarter full. the gap
+	 * between the grow and shrink thresholds keeps a list that hovers around
+	 * one size from reallocating back and forth.
+	 */
+	bool shrinkToUsage()
+	{
+		if(m_capacity > DEFAULT_ALLOCATION_SIZE && m_allocated <= m_capacity/4)
+		{
+			return setCapacity(m_capacity/2);
+		}
+		return true;
+	}
+
+	/**
+	 * @return raw memory at the end of the list for one more element, which
+	 * the caller must construct, then count with ++m_allocated. null on failure.
+	 */
+	DATA_TYPE * rawSlotAtEnd()
+	{
+		if(m_allocated < m_capacity)
+			return m_data+m_allocated;
+		bool allocated = false;
+		NEWMEM_SOURCE_TRACE(allocated = growToFit(m_allocated+1));
+		return allocated ? m_data+m_allocated : 0;
+	}
+
+	/**
+	 * @return true if a_value is one of this list's elements. an element moves
+	 * when the list grows or shifts, so a value passed in from the list itself
+	 * must be copied before the list changes
+	 */
+	inline bool isElement(DATA_TYPE const & a_value) const
+	{
+		return &a_value >= m_data && &a_value < m_data+m_allocated;
+	}
+
+	/**
+	 * add, when the list is full. a_value is copied first if it is an element,
+	 * since growing moves the elements. kept apart from add, so add stays
+	 * small enough to inline into loops
+	 */
+	void addGrowing(DATA_TYPE const & a_value)
+	{
+		if(isElement(a_value))
+		{
+			DATA_TYPE copy(a_value);
+			addGrowing(copy);
+			return;
+		}
+		DATA_TYPE * slot;
+		NEWMEM_SOURCE_TRACE(slot = rawSlotAtEnd());
+		if(!slot)
+			return;
+		new (slot) DATA_TYPE(a_value);
+		++m_allocated;
+	}
+
 public:
 	/** @return true if the given index is safe to access in this array */
 	inline bool isValidIndex(int const a_index) const
@@ -99,6 +356,12 @@ public:
 		return m_allocated;
 	}
 
+	/** @return how many elements can be held before memory must be reallocated */
+	inline const int & capacity() const
+	{
+		return m_capacity;
+	}
+
 	/** @return value (by reference) from the list at given index */
 	inline DATA_TYPE & operator[](const int a_index)
 	{
@@ -139,8 +402,10 @@ public:
 		release();
 		m_data = a_array.m_data;
 		m_allocated = a_array.m_allocated;
+		m_capacity = a_array.m_capacity;
 		a_array.m_data = 0;
 		a_array.m_allocated = 0;
+		a_array.m_capacity = 0;
 	}
 
 	/**
@@ -149,12 +414,33 @@ public:
 	 * @param a_offset should be less than 0
 	 * @param a_last should be greater than than a_from, and 
 	 * (isValidIndex(a_last)||a_last==m_allocated) should return true
+	 * @note bitwise-copyable types are shifted with a single memmove
 	 */
 	inline void moveDown(const int a_from, const int a_offset, const int a_last)
 	{
-		for(int i = a_from-a_offset; i < a_last; ++i)
+		const int first = a_from-a_offset;
+		if(first >= a_last)
+			return;
+#ifdef TEST_OOB
+		if(a_from < 0 || a_last > m_allocated)
+		{
+			int i=0;i=1/i;
+		}
+#endif
+		if(TemplateArrayIsBitwiseCopyable<DATA_TYPE>::value)
+		{
+			memmove((void*)(m_data+first+a_offset), (const void*)(m_data+first), sizeof(DATA_TYPE)*(a_last-first));
+		}
+		else
 		{
-			set(i+a_offset, get(i));
+			for(int i = first; i < a_last; ++i)
+			{
+#ifdef CPP11_HAS_MOVE_SEMANTICS
+				m_data[i+a_offset] = std::move(m_data[i]);
+#else
+				m_data[i+a_offset] = m_data[i];
+#endif
+			}
 		}
 	}
 	/**
@@ -162,12 +448,33 @@ public:
 	 * @param a_from should be a_from 0 <= a_from < m_allocated (not checked)
 	 * @param a_offset should be greater than zero (not checked)
 	 * @param a_last should be 0 < a_last < (m_allocated) (not checked)
+	 * @note bitwise-copyable types are shifted with a single memmove
 	 */
 	inline void moveUp(const int a_from, const int a_offset, const int a_last)
 	{
-		for(int i = a_last-a_offset-1; i >= a_from; --i)
+		const int last = a_last-a_offset;
+		if(a_from >= last)
+			return;
+#ifdef TEST_OOB
+		if(a_from < 0 || a_last > m_allocated)
+		{
+			int i=0;i=1/i;
+		}
+#endif
+		if(TemplateArrayIsBitwiseCopyable<DATA_TYPE>::value)
+		{
+			memmove((void*)(m_data+a_from+a_offset), (const void*)(m_data+a_from), sizeof(DATA_TYPE)*(last-a_from));
+		}
+		else
 		{
-			set(i+a_offset, get(i));
+			for(int i = last-1; i >= a_from; --i)
+			{
+#ifdef CPP11_HAS_MOVE_SEMANTICS
+				m_data[i+a_offset] = std::move(m_data[i]);
+#else
+				m_data[i+a_offset] = m_data[i];
+#endif
+			}
 		}
 	}
 
@@ -175,59 +482,84 @@ public:
 	/** @param a_size reallocate the vector to this size */
 	const bool allocateToSize(const int a_size)
 	{
-		// reallocate a new list with the given size
-#ifndef TEMPLATEARRAY_USES_MALLOC
-		DATA_TYPE * newList = NEWMEM_ARR(DATA_TYPE, a_size);
-#else
-		DATA_TYPE * newList = (DATA_TYPE *)malloc(sizeof(DATA_TYPE)*a_size);
-#endif
-		// if the list could not allocate, fail...
-		if(!newList)	return false;
-		// the temp list is the one we will keep, while the old list will be dropped.
-		DATA_TYPE * oldList = m_data;
-		// swap done here so set(index, value) can be called instead of the equals operator
-		m_data = newList;
-		// if there is old data
-		if(oldList)
+		// when shrinking, the elements past the new size are destroyed first
+		if(a_size < m_allocated)
 		{
-			// when copying old data, make sure no over-writes happen.
-			int smallestSize = m_allocated<a_size?m_allocated:a_size;
-			// fill the new list with the old data
-			for(int i = 0; i < smallestSize; ++i)
-			{
-				set(i, oldList[i]);
-			}
-			// get rid of the old list (so we can maybe use the memory later)
-#ifndef TEMPLATEARRAY_USES_MALLOC
-			DELMEM_ARR(oldList);
-#else
-			free(oldList);
-#endif
+			destroyElements(m_data+a_size, m_allocated-a_size);
+			m_allocated = a_size;
 		}
-		// mark the new allocated size (held size of oldList)
+		if(!setCapacity(a_size))
+			return false;
+		// new elements are default-constructed
+		constructElements(m_data+m_allocated, a_size-m_allocated);
+		// mark the new allocated size
 		m_allocated = a_size;
 		return true;
 	}
 
-	/** note: this method is memory intesive, and should not be in any inner loops... */
+	/**
+	 * @param a_value added to the end of the list
+	 * @note memory grows geometrically, so a series of adds is amortized O(1)
+	 */
 	void add(DATA_TYPE const & a_value)
 	{
-		NEWMEM_SOURCE_TRACE(allocateToSize(size()+1));
-		set(size()-1, a_value);
+		// a local index, so a loop of adds doesn't reload m_allocated from memory it just wrote
+		const int index = m_allocated;
+		if(index >= m_capacity)
+		{
+			NEWMEM_SOURCE_TRACE(addGrowing(a_value));
+			return;
+		}
+		new (m_data+index) DATA_TYPE(a_value);
+		m_allocated = index+1;
 	}
 
-	/** note: this method is memory intesive, and should not be in any inner loops... */
+	/** @return a new default-constructed element at the end of the list, 0 if memory could not be allocated */
 	DATA_TYPE * add()
 	{
-		NEWMEM_SOURCE_TRACE(allocateToSize(size()+1));
-		return &get(size()-1);
+		DATA_TYPE * slot;
+		NEWMEM_SOURCE_TRACE(slot = rawSlotAtEnd());
+		if(!slot)
+			return 0;
+		new (slot) DATA_TYPE;
+		++m_allocated;
+		return slot;
 	}
 
+#if defined(CPP11_HAS_MOVE_SEMANTICS) && defined(CPP11_HAS_VARIADIC_TEMPLATES)
+	/**
+	 * constructs a new element at the end of the list in place
+	 * @param a_args passed to the DATA_TYPE constructor
+	 * @return the new element, 0 if memory could not be allocated
+	 */
+	template<typename... ARGS>
+	DATA_TYPE * emplace(ARGS &&... a_args)
+	{
+		if(m_allocated >= m_capacity)
+		{
+			// the arguments may be elements, which move when the list grows, so the new element is made first
+			DATA_TYPE value(std::forward<ARGS>(a_args)...);
+			DATA_TYPE * slot;
+			NEWMEM_SOURCE_TRACE(slot = rawSlotAtEnd());
+			if(!slot)
+				return 0;
+			new (slot) DATA_TYPE(std::move(value));
+			++m_allocated;
+			return slot;
+		}
+		DATA_TYPE * slot = m_data+m_allocated;
+		new (slot) DATA_TYPE(std::forward<ARGS>(a_args)...);
+		++m_allocated;
+		return slot;
+	}
+#endif
+
 	/** sets all fields to an initial data state. WARNING: can cause memory leaks if used without care */
 	inline void init()
 	{
 		m_data = 0;
 		m_allocated = 0;
+		m_capacity = 0;
 	}
 
 	/** cleans up memory */
@@ -235,18 +567,35 @@ public:
 	{
 		if(m_data)
 		{
-#ifndef TEMPLATEARRAY_USES_MALLOC
-			DELMEM_ARR(m_data);
-#else
-			free(m_data);
-#endif
+			destroyElements(m_data, m_allocated);
+			deleteRawMemory(m_data);
 			m_data = 0;
 			m_allocated = 0;
+			m_capacity = 0;
 		}
 	}
 
 	~TemplateArray(){release();}
 
+	/**
+	 * @return true if there is memory for a_capacity elements
+	 * @note does not change size(), so later adds will not reallocate
+	 */
+	inline bool reserve(const int a_capacity)
+	{
+		if(m_capacity < a_capacity)
+		{
+			return setCapacity(a_capacity);
+		}
+		return true;
+	}
+
+	/** @return true if memory was resized to hold exactly size() elements */
+	inline bool shrinkToFit()
+	{
+		return setCapacity(m_allocated);
+	}
+
 	/** @return true if vector allocated this size */
 	inline bool ensureCapacity(const int a_size)
 	{
@@ -264,13 +613,16 @@ public:
 		{
 			release();
 			bool allocated = false;
-			NEWMEM_SOURCE_TRACE(allocated = allocateToSize(a_array.m_allocated));
+			NEWMEM_SOURCE_TRACE(allocated = setCapacity(a_array.m_allocated));
 			if(!allocated)
 				return false;
+			copyElements(m_data, a_array.m_data, a_array.m_allocated);
+			m_allocated = a_array.m_allocated;
+			return true;
 		}
 		for(int i = 0; i < a_array.m_allocated; ++i)
 		{
-			set(i, a_array.getCONST(i));
+			set(i, a_array.getCONSTREF(i));
 		}
 		return true;
 	}
@@ -288,6 +640,8 @@ public:
 	{
 		m_allocated = a_array.m_allocated;
 		a_array.m_allocated = 0;
+		m_capacity = a_array.m_capacity;
+		a_array.m_capacity = 0;
 		m_data = a_array.m_data;
 		a_array.m_data = 0;
 	}
@@ -313,30 +667,32 @@ public:
 
 #ifdef CPP11_HAS_INITIALIZER_LIST
     TemplateArray( const std::initializer_list <DATA_TYPE> & ilist )
-    	:m_data(0),m_allocated(0)
     {
+        init();
+        setCapacity((int)ilist.size());
         auto it = ilist.begin();
-        allocateToSize(ilist.size());
-        int index = 0;
         while( it != ilist.end() ) {
-        	set(index++, *it);
+        	new (m_data+m_allocated++) DATA_TYPE(*it);
             it++;
         }
     }
 #endif
 
-#ifdef CPP11_HAS_LAMBDA_SEMANTICS
-	/** @param f execute this code for each element of this container */
-	void for_each_full(std::function<void (DATA_TYPE & value, const int index)> f){
-		for(int i = 0; i < size(); ++i)
-			f(TemplateArray<DATA_TYPE>::get(i), i);
+	/**
+	 * @param f execute this code for each element of this container, called
+	 * as f(value, index). a template, so lambdas and functors get inlined
+	 */
+	template<typename FUNCTION>
+	void for_each_full(FUNCTION f){
+		for(int i = 0; i < m_allocated; ++i)
+			f(m_data[i], i);
 	}
-	/** @param f execute this code for each element of this container */
-	void for_each(std::function<void (DATA_TYPE & value)> f){
-		for(int i = 0; i < size(); ++i)
-			f(TemplateArray<DATA_TYPE>::get(i));
+	/** @param f execute this code for each element, called as f(value) */
+	template<typename FUNCTION>
+	void for_each(FUNCTION f){
+		for(int i = 0; i < m_allocated; ++i)
+			f(m_data[i]);
 	}
-#endif
 
 	/** explicit copy operator overload */
 	inline TemplateArray & operator=(TemplateArray<DATA_TYPE> const & a_array){
@@ -360,9 +716,13 @@ public:
 	inline TemplateArray(const int a_size, DATA_TYPE const & a_defaultValue)
 	{
 		init();
-		NEWMEM_SOURCE_TRACE(ensureCapacity(a_size));
-		for(int i = 0; i < a_size; ++i)
-			set(i, a_defaultValue);
+		bool allocated = false;
+		NEWMEM_SOURCE_TRACE(allocated = setCapacity(a_size));
+		if(allocated)
+		{
+			constructElements(m_data, a_size, a_defaultValue);
+			m_allocated = a_size;
+		}
 	}
 
 	/** @return the last value in the list */
@@ -380,25 +740,68 @@ public:
 		return m_data;
 	}
 
+	/** @return the raw pointer to the data, read only */
+	inline DATA_TYPE const * getRawListConst() const
+	{
+		return m_data;
+	}
+
+	/** random access iterators, for range-for loops and <algorithm> */
+	typedef DATA_TYPE * iterator;
+	typedef DATA_TYPE const * const_iterator;
+	typedef DATA_TYPE value_type;
+
+	/** @return iterator to the first element. adding or removing elements invalidates it */
+	inline iterator begin() { return m_data; }
+	/** @return iterator past the last element */
+	inline iterator end() { return m_data+m_allocated; }
+	inline const_iterator begin() const { return m_data; }
+	inline const_iterator end() const { return m_data+m_allocated; }
+
 	/** 
 	 * @param a_index is overwritten by the next element, which is 
 	 * overwritten by the next element, and so on, till the last element
-	 * @note this operation could be memory intensive!
+	 * @note memory is given back once the list is a quarter full
 	 */
 	void remove(const int a_index)
 	{
 		moveDown(a_index, -1, size());
-		NEWMEM_SOURCE_TRACE(allocateToSize(m_allocated-1));
+		destroyElements(m_data+m_allocated-1, 1);
+		--m_allocated;
+		NEWMEM_SOURCE_TRACE(shrinkToUsage());
 	}
 
 	/** 
 	 * @param a_index where to insert a_value. shifts elements in the vector.
-	 * @note this operation could be memory intensive!
+	 * @note shifting is O(n), memory growth is amortized like add()
 	 */
 	void insert(const int a_index, DATA_TYPE const & a_value)
 	{
-		NEWMEM_SOURCE_TRACE(allocateToSize(m_allocated+1));
-		moveUp(a_index, 1, size());
+		if(isElement(a_value))
+		{
+			// a_value is about to be shifted (or moved by growing), so it is copied first
+			DATA_TYPE copy(a_value);
+			NEWMEM_SOURCE_TRACE(insert(a_index, copy));
+			return;
+		}
+		DATA_TYPE * slot;
+		NEWMEM_SOURCE_TRACE(slot = rawSlotAtEnd());
+		if(!slot)
+			return;
+		if(a_index == m_allocated)
+		{
+			new (slot) DATA_TYPE(a_value);
+			++m_allocated;
+			return;
+		}
+		// the last element moves into the new slot, the rest shift up by one
+#ifdef CPP11_HAS_MOVE_SEMANTICS
+		new (slot) DATA_TYPE(std::move(m_data[m_allocated-1]));
+#else
+		new (slot) DATA_TYPE(m_data[m_allocated-1]);
+#endif
+		++m_allocated;
+		moveUp(a_index, 1, m_allocated-1);
 		set(a_index, a_value);
 	}
 
@@ -413,12 +816,14 @@ public:
 	/** @return index of 1st a_value at or after a_startingIndex. uses == */
 	inline int indexOf(DATA_TYPE const & a_value, const int a_startingIndex, const int a_endingIndex) const
 	{
-		for(int i = a_startingIndex; i < a_endingIndex; ++i)
+#ifdef TEST_OOB
+		if(a_startingIndex < a_endingIndex
+		&& (a_startingIndex < 0 || a_endingIndex > m_allocated))
 		{
-			if(getCONST(i) == a_value)
-				return i;
+			int i=0;i=1/i;
 		}
-		return -1;
+#endif
+		return TemplateScan::indexOf(m_data, a_startingIndex, a_endingIndex, a_value);
 	}
 
 	/** @return index of 1st a_value at or after a_startingIndex. uses == */
@@ -428,36 +833,98 @@ public:
 	}
 
 	/**
-	 * will only work correctly if the TemplateVector is sorted.
-	 * @return the index of the given value, -1 if the value is not in the list
+	 * will only work correctly if [a_first, a_limit) is sorted (uses less than).
+	 * @return index of the first element in [a_first, a_limit) not less than
+	 * a_value, a_limit if every element is less than a_value
+	 */
+	inline int lowerBound(DATA_TYPE const & a_value, int const a_first, int const a_limit) const
+	{
+		return a_first + TemplateSearch::lowerBound(m_data+a_first, a_limit-a_first,
+			a_value, TemplateSort::Less<DATA_TYPE>());
+	}
+
+	/**
+	 * will only work correctly if [a_first, a_limit) is sorted (uses less than).
+	 * @return index of the first element in [a_first, a_limit) greater than
+	 * a_value, a_limit if there is none
+	 */
+	inline int upperBound(DATA_TYPE const & a_value, int const a_first, int const a_limit) const
+	{
+		return a_first + TemplateSearch::upperBound(m_data+a_first, a_limit-a_first,
+			a_value, TemplateSort::Less<DATA_TYPE>());
+	}
+
+	/**
+	 * will only work correctly if the TemplateVector is sorted (uses less than).
+	 * @return the index of the first a_value, -1 if the value is not in the list
 	 */
 	int indexOfWithBinarySearch(DATA_TYPE const & a_value, int const a_first, int const a_limit) const
 	{
-		if(m_allocated)
-		{
-			int first = a_first, last = a_limit;
-			while (first <= last)
-			{
-				int mid = (first + last) / 2;  // compute mid point.
-				if (a_value > m_data[mid]) 
-					first = mid + 1;  // repeat search in top half.
-				else if (a_value < m_data[mid]) 
-					last = mid - 1; // repeat search in bottom half.
-				else
-					return mid;     // found it. return position
-			}
-		}
+		int index = lowerBound(a_value, a_first, a_limit);
+		if(index < a_limit && !(a_value < m_data[index]))
+			return index;
 		return -1;    // failed to find key
 	}
 
 	void setAll(DATA_TYPE const & a_value)
 	{
-		for(int i = 0; i < size(); ++i)
-		{
-			set(i, a_value);
-		}
+		TemplateScan::setAll(m_data, m_allocated, a_value);
+	}
+
+	/** sorts the elements in [a_first, a_limit) using operator< */
+	void sort(const int a_first, const int a_limit)
+	{
+		TemplateSort::sort(m_data+a_first, a_limit-a_first);
+	}
+
+	/** sorts [a_first, a_limit) using operator<, keeping equal elements in order */
+	void sortStable(const int a_first, const int a_limit)
+	{
+		TemplateSort::sortStable(m_data+a_first, a_limit-a_first);
+	}
+
+	/**
+	 * sorts the elements in [a_first, a_limit)
+	 * @param aBeforeB called as aBeforeB(a, b), true if a should come before b.
+	 * a lambda or functor here can be inlined, unlike a std::function.
+	 */
+	template<typename LESS>
+	void sortFunction(const int a_first, const int a_limit, LESS aBeforeB)
+	{
+		TemplateSort::introsort(m_data+a_first, a_limit-a_first, aBeforeB);
 	}
 
+	/** like sortFunction, but keeps elements that are not aBeforeB each other in order */
+	template<typename LESS>
+	void sortStableFunction(const int a_first, const int a_limit, LESS aBeforeB)
+	{
+		TemplateSort::stableSort(m_data+a_first, a_limit-a_first, aBeforeB);
+	}
+
+#ifdef CPP11_HAS_THREADS
+	/**
+	 * sorts [a_first, a_limit) using operator< and a_threadCount threads.
+	 * @param a_threadCount 0 uses one thread per core. small ranges sort serially
+	 */
+	void sortParallel(const int a_first, const int a_limit, const int a_threadCount)
+	{
+		TemplateSort::parallelSort(m_data+a_first, a_limit-a_first, a_threadCount);
+	}
+
+	/** like sortParallel, keeping equal elements in order */
+	void sortStableParallel(const int a_first, const int a_limit, const int a_threadCount)
+	{
+		TemplateSort::parallelSortStable(m_data+a_first, a_limit-a_first, a_threadCount);
+	}
+
+	/** like sortFunction, using a_threadCount threads (0 is one per core) */
+	template<typename LESS>
+	void sortFunctionParallel(const int a_first, const int a_limit, LESS aBeforeB, const int a_threadCount)
+	{
+		TemplateSort::parallelSort(m_data+a_first, a_limit-a_first, aBeforeB, a_threadCount);
+	}
+#endif
+
 	/** @return if linear pass proved all elements in order (uses less than) */
 	bool isSorted() const
 	{
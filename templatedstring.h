@@ -426,6 +426,13 @@ public:
 	inline TYPE getCONST(const int a_index) const {
 		return data[a_index];
 	}
+
+	/**
+	 * read-only random access iterators, for range-for and <algorithm>. there
+	 * is no mutable version, since the string may be in read-only memory
+	 */
+	inline const TYPE * begin() const { return data; }
+	inline const TYPE * end() const { return data+size; }
 	/** @param a_value what value to put in the given index */
 	inline void set(int const & a_index, TYPE const & a_value){
 		if(!isMutable()){printf("set wont work\n");int i=0;i=1/i;}	// do not allow modification of immutable strings
@@ -0,0 +1,242 @@
+#pragma once
+
+#include "license.txt"
+#include "templatevector.h"
+
+/**
+ * an ordered map kept as two sorted TemplateVectors: one of keys, and one of
+ * the values that go with them, at the same index. a lookup binary-searches
+ * the keys alone, so every cache line it reads is full of keys. there is no
+ * per-element allocation, and iterating is a walk down two arrays.
+ *
+ * set and erase shift the elements after the key, so one-at-a-time changes
+ * cost O(n). build a map in one go with build, and add many keys at once
+ * with setBulk, which sort the batch and merge it in one pass. a good fit
+ * for small to medium maps that are read much more than they are written.
+ * @note KEY needs operator<. KEY and VALUE need default constructors
+ */
+template <class KEY, class VALUE>
+class TemplateFlatMap
+{
+	/** sorted, no duplicates */
+	TemplateVector<KEY> m_keys;
+	/** m_values[i] goes with m_keys[i] */
+	TemplateVector<VALUE> m_values;
+
+	/** orders indexes into a key array by the keys they point at */
+	struct IndexLess
+	{
+		KEY const * keys;
+		IndexLess(KEY const * a_keys):keys(a_keys){}
+		inline bool operator()(const int a, const int b) const { return keys[a] < keys[b]; }
+	};
+#ifdef CPP11_HAS_MOVE_SEMANTICS
+#define TEMPLATEFLATMAP_MOVE(value)	std::move(value)
+#else
+#define TEMPLATEFLATMAP_MOVE(value)	(value)
+#endif
+public:
+	/** @return how many key/value pairs are in the map */
+	inline int size() const { return m_keys.size(); }
+
+	/** @return the index of the first key not less than a_key (size() if there is none) */
+	inline int lowerBound(KEY const & a_key) const { return m_keys.lowerBound(a_key, 0, size()); }
+	/** @return the index of the first key greater than a_key (size() if there is none) */
+	inline int upperBound(KEY const & a_key) const { return m_keys.upperBound(a_key, 0, size()); }
+
+	/** @return the index of a_key, -1 if it is not in the map */
+	int indexOf(KEY const & a_key) const
+	{
+		const int index = lowerBound(a_key);
+		return (index < size() && !(a_key < m_keys.getRawListConst()[index])) ? index : -1;
+	}
+
+	/** @return the key at a_index, in sorted order */
+	inline KEY const & getKey(const int a_index) const { return m_keys.getCONSTREF(a_index); }
+	/** @return the value that goes with the key at a_index */
+	inline VALUE & getValue(const int a_index) { return m_values[a_index]; }
+	inline VALUE const & getValue(const int a_index) const { return m_values.getCONSTREF(a_index); }
+
+	/** @return all of the keys, sorted */
+	inline TemplateVector<KEY> const & getKeys() const { return m_keys; }
+	/** @return all of the values, in the same order as getKeys */
+	inline TemplateVector<VALUE> const & getValues() const { return m_values; }
+
+	/** @return the value associated with the given KEY, 0 if there is none */
+	VALUE * getByKey(KEY const & a_key)
+	{
+		const int index = indexOf(a_key);
+		return (index < 0) ? 0 : (m_values.getRawList()+index);
+	}
+	/** @return the value associated with the given KEY, 0 if there is none */
+	VALUE const * getByKey(KEY const & a_key) const
+	{
+		const int index = indexOf(a_key);
+		return (index < 0) ? 0 : (m_values.getRawListConst()+index);
+	}
+
+	/**
+	 * sets up a key/value pair association, replacing the key's old value
+	 * @return the index of the key, -1 if memory could not be allocated
+	 */
+	int set(KEY const & a_key, VALUE const & a_value)
+	{
+		const int index = lowerBound(a_key);
+		if(index < size() && !(a_key < m_keys.getRawListConst()[index]))
+		{
+			m_values[index] = a_value;
+			return index;
+		}
+		const int count = size();
+		NEWMEM_SOURCE_TRACE(m_keys.insert(index, a_key));
+		if(m_keys.size() == count)
+			return -1;
+		NEWMEM_SOURCE_TRACE(m_values.insert(index, a_value));
+		if(m_values.size() == count)
+		{
+			m_keys.remove(index);
+			return -1;
+		}
+		return index;
+	}
+
+	/** @return false if a_key was not in the map */
+	bool erase(KEY const & a_key)
+	{
+		const int index = indexOf(a_key);
+		if(index < 0)
+			return false;
+		removeAt(index);
+		return true;
+	}
+
+	/** removes the key/value pair at a_index */
+	void removeAt(const int a_index)
+	{
+		m_keys.remove(a_index);
+		m_values.remove(a_index);
+	}
+
+	/**
+	 * sets many key/value pairs at once: a_values[i] goes with a_keys[i].
+	 * the batch is sorted, then merged in from the back, so each element of
+	 * the map moves at most once. if a key is in the batch more than once,
+	 * the last one wins, as if set were called for each pair in order
+	 * @return how many keys were new to the map, 0 if memory could not be
+	 * allocated for them (the keys already in the map are still updated)
+	 */
+	int setBulk(KEY const * a_keys, VALUE const * a_values, const int a_count)
+	{
+		if(a_count <= 0)
+			return 0;
+		// the batch's indexes, sorted by key. stable, so the last of equal keys is last
+		TemplateVector<int> order;
+		bool allocated = false;
+		NEWMEM_SOURCE_TRACE(allocated = order.ensureCapacity(a_count));
+		if(!allocated)
+			return 0;
+		for(int i = 0; i < a_count; ++i)
+			order.add(i);
+		order.sortStableFunction(IndexLess(a_keys));
+		int * in = order.getRawList();
+		// update the keys already in the map, and keep the new ones
+		const int count = size();
+		KEY const * keys = m_keys.getRawListConst();
+		int fresh = 0, existing = 0;
+		for(int i = 0; i < a_count; ++i)
+		{
+			const int o = in[i];
+			if(i+1 < a_count && !(a_keys[o] < a_keys[in[i+1]]))
+				continue;
+			existing = m_keys.lowerBound(a_keys[o], existing, count);
+			if(existing < count && !(a_keys[o] < keys[existing]))
+				m_values[existing] = a_values[o];
+			else
+				in[fresh++] = o;
+		}
+		if(!fresh)
+			return 0;
+		NEWMEM_SOURCE_TRACE(allocated = m_keys.setSize(count+fresh));
+		if(!allocated)
+			return 0;
+		NEWMEM_SOURCE_TRACE(allocated = m_values.setSize(count+fresh));
+		if(!allocated)
+		{
+			m_keys.setSize(count);
+			return 0;
+		}
+		KEY * k = m_keys.getRawList();
+		VALUE * v = m_values.getRawList();
+		int i = count-1, j = fresh-1, w = count+fresh-1;
+		while(j >= 0)
+		{
+			if(i >= 0 && a_keys[in[j]] < k[i])
+			{
+				k[w] = TEMPLATEFLATMAP_MOVE(k[i]);
+				v[w] = TEMPLATEFLATMAP_MOVE(v[i]);
+				--i;
+			}
+			else
+			{
+				k[w] = a_keys[in[j]];
+				v[w] = a_values[in[j]];
+				--j;
+			}
+			--w;
+		}
+		return fresh;
+	}
+
+	/** replaces the contents of the map with a_count key/value pairs, in any order. see setBulk */
+	void build(KEY const * a_keys, VALUE const * a_values, const int a_count)
+	{
+		clear();
+		setBulk(a_keys, a_values, a_count);
+	}
+
+	/** makes room for a_count pairs without reallocating */
+	void reserve(const int a_count)
+	{
+		NEWMEM_SOURCE_TRACE(m_keys.ensureCapacity(a_count));
+		NEWMEM_SOURCE_TRACE(m_values.ensureCapacity(a_count));
+	}
+
+	/** removes every pair, keeping the memory */
+	void clear()
+	{
+		m_keys.clear();
+		m_values.clear();
+	}
+
+	/** removes every pair, and frees the memory */
+	void release()
+	{
+		m_keys.release();
+		m_values.release();
+	}
+
+	/** @param f called as f(key, value) for each pair, in key order */
+	template<typename FUNCTION>
+	void for_each(FUNCTION f)
+	{
+		for_each_index(0, size(), f);
+	}
+
+	/** @param f called as f(key, value) for each pair with a key in [a_first, a_limit), in key order */
+	template<typename FUNCTION>
+	void for_each_in_range(KEY const & a_first, KEY const & a_limit, FUNCTION f)
+	{
+		for_each_index(lowerBound(a_first), lowerBound(a_limit), f);
+	}
+
+	/** @param f called as f(key, value) for each pair from index a_first up to (not including) a_limit */
+	template<typename FUNCTION>
+	void for_each_index(const int a_first, const int a_limit, FUNCTION f)
+	{
+		KEY const * k = m_keys.getRawListConst();
+		VALUE * v = m_values.getRawList();
+		for(int i = a_first; i < a_limit; ++i)
+			f(k[i], v[i]);
+	}
+#undef TEMPLATEFLATMAP_MOVE
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "license.txt"
+#include "templatevector.h"
+#include "templatesearch.h"
+
+/**
+ * a read-only copy of a sorted TemplateVector, laid out for fast searching.
+ * elements are stored in Eytzinger (breadth-first binary tree) order: the
+ * first levels of the search share a few cache lines, and the children of a
+ * node sit next to each other, so a search can prefetch several levels ahead.
+ * beats TemplateVector::indexOfWithBinarySearch on large lists that are
+ * searched many times and rarely changed. to change the data, change the
+ * sorted TemplateVector and freeze it again.
+ * @author mvaganov@hotmail.com
+ */
+template<typename DATA_TYPE>
+class TemplateFrozenVector
+{
+protected:
+	/** 1-indexed Eytzinger tree. element 0 is unused */
+	TemplateArray<DATA_TYPE> m_tree;
+	/** m_rank[k] is the sorted index of m_tree[k] */
+	TemplateArray<int> m_rank;
+	/** how many elements are in the tree */
+	int m_count;
+public:
+	TemplateFrozenVector():m_count(0){}
+
+	/** @param a_sorted a sorted list to copy. see freeze */
+	TemplateFrozenVector(TemplateArray<DATA_TYPE> const & a_sorted):m_count(0)
+	{
+		freeze(a_sorted);
+	}
+
+	/**
+	 * replaces this with a copy of a_sorted, re-ordered for searching
+	 * @param a_sorted must be sorted (by operator<)
+	 * @return false if memory could not be allocated. this is then empty
+	 */
+	bool freeze(TemplateArray<DATA_TYPE> const & a_sorted)
+	{
+		const int count = a_sorted.size();
+		bool allocated = false;
+		NEWMEM_SOURCE_TRACE(allocated = m_tree.allocateToSize(count+1)
+			&& m_rank.allocateToSize(count+1));
+		if(!allocated)
+		{
+			release();
+			return false;
+		}
+		m_count = count;
+		m_rank.set(0, -1);
+		TemplateSearch::eytzingerFill(a_sorted.getRawListConst(), m_count,
+			m_tree.getRawList(), m_rank.getRawList());
+		return true;
+	}
+
+	/** frees the data */
+	void release()
+	{
+		m_tree.release();
+		m_rank.release();
+		m_count = 0;
+	}
+
+	/** @return how many elements were frozen */
+	inline int size() const { return m_count; }
+
+	/**
+	 * @return index (in the original sorted list) of the first element not
+	 * less than a_value, size() if there is none
+	 */
+	inline int lowerBound(DATA_TYPE const & a_value) const
+	{
+		const int k = TemplateSearch::eytzingerLowerBound(m_tree.getRawListConst(), m_count,
+			a_value, TemplateSort::Less<DATA_TYPE>());
+		return k ? m_rank.getCONST(k) : m_count;
+	}
+
+	/** @return pointer to the first element equal to a_value, NULL if not found */
+	inline DATA_TYPE const * find(DATA_TYPE const & a_value) const
+	{
+		const int k = TemplateSearch::eytzingerLowerBound(m_tree.getRawListConst(), m_count,
+			a_value, TemplateSort::Less<DATA_TYPE>());
+		if(k && !(a_value < m_tree.getCONSTREF(k)))
+			return &m_tree.getCONSTREF(k);
+		return 0;
+	}
+
+	/**
+	 * same result as indexOfWithBinarySearch on the original sorted list
+	 * @return the index of the first a_value, -1 if the value is not in the list
+	 */
+	inline int indexOfWithBinarySearch(DATA_TYPE const & a_value) const
+	{
+		const int k = TemplateSearch::eytzingerLowerBound(m_tree.getRawListConst(), m_count,
+			a_value, TemplateSort::Less<DATA_TYPE>());
+		if(k && !(a_value < m_tree.getCONSTREF(k)))
+			return m_rank.getCONST(k);
+		return -1;
+	}
+};
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "license.txt"
+
+#include <string.h>	// memcpy, strlen
+#include <stddef.h>	// size_t
+
+/**
+ * hash functions for TemplateHashMap. each returns a full-width hash, with
+ * every bit depending on every bit of the key. the hash map reduces it to a
+ * slot index itself.
+ * @author mvaganov@hotmail.com
+ */
+namespace TemplateHash
+{
+	/** scrambles all 64 bits of a_value into all 64 bits of the result (murmur3's finalizer) */
+	inline unsigned long long mix64(unsigned long long a_value)
+	{
+		a_value ^= a_value >> 33;
+		a_value *= 0xff51afd7ed558ccdull;
+		a_value ^= a_value >> 33;
+		a_value *= 0xc4ceb9fe1a85ec53ull;
+		a_value ^= a_value >> 33;
+		return a_value;
+	}
+
+	/** a_a * a_b as 128 bits: the low 64 bits go to a_a, the high 64 bits to a_b */
+	inline void multiply128(unsigned long long & a_a, unsigned long long & a_b)
+	{
+#if defined(__SIZEOF_INT128__)
+		unsigned __int128 product = (unsigned __int128)a_a * a_b;
+		a_a = (unsigned long long)product;
+		a_b = (unsigned long long)(product >> 64);
+#else
+		const unsigned long long aLow = a_a & 0xffffffffull, aHigh = a_a >> 32;
+		const unsigned long long bLow = a_b & 0xffffffffull, bHigh = a_b >> 32;
+		const unsigned long long lowLow = aLow * bLow, lowHigh = aLow * bHigh;
+		const unsigned long long highLow = aHigh * bLow, highHigh = aHigh * bHigh;
+		const unsigned long long middle = (lowLow >> 32) + (lowHigh & 0xffffffffull) + (highLow & 0xffffffffull);
+		a_a = (middle << 32) | (lowLow & 0xffffffffull);
+		a_b = highHigh + (lowHigh >> 32) + (highLow >> 32) + (middle >> 32);
+#endif
+	}
+
+	/** @return a_a * a_b as 128 bits, the high 64 bits xor the low 64 bits */
+	inline unsigned long long multiplyFold(unsigned long long a_a, unsigned long long a_b)
+	{
+		multiply128(a_a, a_b);
+		return a_a ^ a_b;
+	}
+
+	inline unsigned long long read8(const unsigned char * a_bytes) { unsigned long long v; memcpy(&v, a_bytes, 8); return v; }
+	inline unsigned long long read4(const unsigned char * a_bytes) { unsigned int v; memcpy(&v, a_bytes, 4); return v; }
+
+	/**
+	 * hashes every byte of a_data, in the style of wyhash: 16 bytes at a time
+	 * through a 64x64->128 bit multiply, three lanes at a time for long keys
+	 * @param a_seed changes the hash, to make collisions hard to predict
+	 */
+	inline unsigned long long hashBytes(const void * a_data, const size_t a_length, unsigned long long a_seed = 0)
+	{
+		static const unsigned long long SECRET[4] = {
+			0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull };
+		const unsigned char * p = (const unsigned char *)a_data;
+		unsigned long long seed = a_seed ^ multiplyFold(a_seed ^ SECRET[0], SECRET[1]);
+		unsigned long long a, b;
+		if(a_length <= 16)
+		{
+			if(a_length >= 4)
+			{
+				// two overlapping reads from each end cover 4 to 16 bytes
+				const size_t quarter = (a_length >> 3) << 2;
+				a = (read4(p) << 32) | read4(p+quarter);
+				b = (read4(p+a_length-4) << 32) | read4(p+a_length-4-quarter);
+			}
+			else if(a_length > 0)
+			{
+				a = ((unsigned long long)p[0] << 16) | ((unsigned long long)p[a_length >> 1] << 8) | p[a_length-1];
+				b = 0;
+			}
+			else
+				a = b = 0;
+		}
+		else
+		{
+			size_t i = a_length;
+			if(i > 48)
+			{
+				unsigned long long seed1 = seed, seed2 = seed;
+				do
+				{
+					seed = multiplyFold(read8(p) ^ SECRET[1], read8(p+8) ^ seed);
+					seed1 = multiplyFold(read8(p+16) ^ SECRET[2], read8(p+24) ^ seed1);
+					seed2 = multiplyFold(read8(p+32) ^ SECRET[3], read8(p+40) ^ seed2);
+					p += 48;
+					i -= 48;
+				}
+				while(i > 48);
+				seed ^= seed1 ^ seed2;
+			}
+			while(i > 16)
+			{
+				seed = multiplyFold(read8(p) ^ SECRET[1], read8(p+8) ^ seed);
+				p += 16;
+				i -= 16;
+			}
+			// the last 16 bytes, overlapping what was already read
+			a = read8(p+i-16);
+			b = read8(p+i-8);
+		}
+		a ^= SECRET[1];
+		b ^= seed;
+		multiply128(a, b);
+		return multiplyFold(a ^ SECRET[0] ^ a_length, b ^ SECRET[1]);
+	}
+}
+
+/**
+ * the hash functor TemplateHashMap uses for KEY. works for integers, enums
+ * and pointers. specialize it (a const operator() returning size_t) to hash
+ * other key types.
+ */
+template<typename KEY>
+struct TemplateHasher
+{
+	inline size_t operator()(KEY const & a_key) const
+	{
+		return (size_t)TemplateHash::mix64((unsigned long long)a_key);
+	}
+};
+
+/** hashes the bits of the float, with -0 and 0 hashing the same since they compare equal */
+template<>
+struct TemplateHasher<float>
+{
+	inline size_t operator()(float const & a_key) const
+	{
+		unsigned int bits = 0;
+		if(a_key != 0)
+			memcpy(&bits, &a_key, sizeof(bits));
+		return (size_t)TemplateHash::mix64(bits);
+	}
+};
+
+/** hashes the bits of the double, with -0 and 0 hashing the same since they compare equal */
+template<>
+struct TemplateHasher<double>
+{
+	inline size_t operator()(double const & a_key) const
+	{
+		unsigned long long bits = 0;
+		if(a_key != 0)
+			memcpy(&bits, &a_key, sizeof(bits));
+		return (size_t)TemplateHash::mix64(bits);
+	}
+};
+
+/**
+ * hashes every character of a null-terminated string, or of a (pointer, length)
+ * slice. a string and a slice with the same characters hash the same
+ */
+struct TemplateStringHasher
+{
+	inline size_t operator()(const char * const & a_key) const
+	{
+		return (size_t)TemplateHash::hashBytes(a_key, strlen(a_key));
+	}
+	inline size_t operator()(const char * a_key, const int a_length) const
+	{
+		return (size_t)TemplateHash::hashBytes(a_key, (size_t)a_length);
+	}
+};
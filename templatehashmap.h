@@ -2,8 +2,42 @@
 
 #include "license.txt"
 #include "templatevector.h"
+#include "templatehash.h"
 #include "string.h"
 
+#include <iterator>	// std::forward_iterator_tag
+#include <stddef.h>	// ptrdiff_t
+#include <stdio.h>	// printf
+
+/**
+ * uncomment to have every TemplateHashMap count its lookups, hits, misses
+ * and rehashes (see TemplateHashMapStats). costs an increment or two per
+ * lookup, and the counters are not atomic, so TemplateHashMapConcurrent's
+ * counts are only approximate
+ */
+//#define TEMPLATEHASHMAP_STATS
+
+/** a snapshot of how well a TemplateHashMap is hashing, from TemplateHashMap_BASE::getStats */
+struct TemplateHashMapStats
+{
+	/** longest probe that gets tracked: TemplateHashMap_BASE's limit on how far an element is from home */
+	static const int MAX_PROBE = 127;
+	int size, capacity;
+	/** size / capacity */
+	float loadFactor;
+	/** probeHistogram[n] is how many elements are found after probing n slots */
+	int probeHistogram[MAX_PROBE+1];
+	/** the longest probe of any element */
+	int maxProbe;
+	/** average probe of the elements, and the average a good hash would give at this load factor */
+	float meanProbe, expectedMeanProbe;
+	// only counted with TEMPLATEHASHMAP_STATS, 0 otherwise
+	/** lookups since the last resetStats (set and erase look up too), and how many found their key */
+	long long lookups, hits, misses;
+	/** times the table was rebuilt, and how many of those were forced by a probe too long for its load */
+	int rehashes, overflowRehashes;
+};
+
 template <class KEY, class VALUE>
 struct KeyValuePair
 {
@@ -16,14 +50,10 @@ struct KeyValuePair
 	bool operator>(KeyValuePair<KEY,VALUE> const & kvp)const{return k > kvp.k;}
 	bool operator==(KeyValuePair<KEY,VALUE> const& kvp)const{return k ==kvp.k;}
 	bool operator!=(KeyValuePair<KEY,VALUE> const& kvp)const{return !operator==(kvp);}
-	static int hashFunction(KEY const & k)
-	{
-		// the KEY could very likely be pointer. This hash will turn memory 
-		// addresses that are int-aligned into possibly consecutive keys, and
-		// essentially modulo 32, accomplished here by bitwise-and-ing 32-1
-		// TODO ptrdiff_t
-		return (((int)k) >> (sizeof(int) >> 1)) & 31;
-	}
+	/** the default hash functor for KEY */
+	typedef TemplateHasher<KEY> Hasher;
+	static size_t hashFunction(KEY const & k){return Hasher()(k);}
+	static bool keyEquals(KEY const & a, KEY const & b){return a == b;}
 };
 
 template <class VALUE>
@@ -38,102 +68,1068 @@ struct NameValuePair
 	bool operator>(NameValuePair<VALUE> const & kvp)const{return strcmp(k, kvp.k) > 0;}
 	bool operator==(NameValuePair<VALUE> const& kvp)const{return strcmp(k, kvp.k) ==0;}
 	bool operator!=(NameValuePair<VALUE> const& kvp)const{return !operator==(kvp);}
-	static int hashFunction(const char* const & k){return ((k[0]+k[1]) & 31);}
+	/** the default hash functor, which hashes the whole string */
+	typedef TemplateStringHasher Hasher;
+	static size_t hashFunction(const char* const & k){return Hasher()(k);}
+	/** the same pointer is the same string, which makes keys from a TemplateStringPool quick to compare */
+	static bool keyEquals(const char* const & a, const char* const & b){return a == b || strcmp(a, b) == 0;}
+	/** @return true if null-terminated a is the same as the b_length characters at b, which need no terminator */
+	static bool keyEquals(const char* const & a, const char * b, const int b_length){
+		for(int i = 0; i < b_length; ++i){
+			if(a[i] != b[i] || !a[i])
+				return false;
+		}
+		return a[b_length] == '\0';
+	}
 };
 
+template <typename TYPE> class TemplatedString;
+struct TemplateHashMapSnapshot;
+
 /**
- * a simple HashMap data structure, using TemplateVectors of KeyValuePairs as
- * buckets. The hash size is DEFAULT_BUCKET_SIZE, or 32. The hashFunction 
- * values between 0 and 31 by bitshifting and masking
+ * a flat HashMap data structure, using open addressing with Robin Hood
+ * hashing: an element that is farther from its home slot than the element
+ * in its way takes that slot, and the displaced element keeps probing. this
+ * keeps probe lengths short and even, and lets a lookup stop as soon as it
+ * meets an element that is closer to home than the key would be.
+ *
+ * elements live in one array of KVP_STRUCTs. two byte arrays hold each
+ * slot's probe distance (0 is empty) and 8 bits of its hash, so probing
+ * rarely touches the elements themselves. with SSE2, 16 slots are probed at
+ * once. the table doubles when it passes the max load factor. erase shifts
+ * the elements after the removed one back a slot, instead of leaving a
+ * tombstone, so a map that churns keys keeps the probe lengths of a fresh one.
+ *
+ * a map that is built once and then only read can be frozen into a minimal
+ * perfect hash, see freeze. a map of bitwise copyable keys and values can be
+ * saved to a file, and used straight from the mapped file, see
+ * TemplateHashMapSnapshot in templatehashmapsnapshot.h.
+ * KVP_STRUCT needs a static keyEquals(KEY, KEY). HASHER is a functor
+ * returning a full-width size_t hash of a KEY (see TemplateHasher).
  */
-template <class KEY, class VALUE, class KVP_STRUCT>
+template <class KEY, class VALUE, class KVP_STRUCT, class HASHER = typename KVP_STRUCT::Hasher>
 class TemplateHashMap_BASE
 {
-	TemplateVector<TemplateVector<KVP_STRUCT>*> hash;
+	/** saves tables to snapshot files, and uses them from there. kept in its own header, which needs OS headers */
+	friend struct TemplateHashMapSnapshot;
 
 	// using #define instead of const int to reduce templated-member ambiguities
-#define __DEFAULT_BUCKET_SIZE 32
+	/** slots probed at once. metadata for the first __GROUP_SIZE slots is mirrored after the end */
+#define __GROUP_SIZE 16
+	/** farthest an element can be from its home slot before the table grows */
+#define __MAX_PROBE 127
+#define __DEFAULT_MAX_LOAD_FACTOR 0.875f
+
+	/** the elements. only slots with m_distance != 0 are constructed */
+	KVP_STRUCT * m_slots;
+	/** 1 + how far each slot's element is from its home slot. 0 means empty */
+	unsigned char * m_distance;
+	/** 8 bits of each slot's hash, checked before comparing keys */
+	unsigned char * m_tag;
+	/** how many slots there are. always 0 or a power of 2 */
+	int m_capacity;
+	/** 64 - log2(m_capacity): shifts a mixed hash down to a slot index */
+	int m_shift;
+	/** no distance is larger than this. an insert adds at most 1 to it, so it only fails when this is __MAX_PROBE */
+	int m_mostDistance;
+	/** grow when numElements would pass m_capacity * m_maxLoadFactor */
+	float m_maxLoadFactor;
 
 	int numElements;
+
+	/** hashes keys */
+	HASHER m_hasher;
+
+#ifdef TEMPLATEHASHMAP_STATS
+	mutable long long m_lookups, m_hits;
+	int m_rehashes, m_overflowRehashes;
+#define TEMPLATEHASHMAP_COUNT(EXPRESSION)	EXPRESSION
+#else
+#define TEMPLATEHASHMAP_COUNT(EXPRESSION)
+#endif
+
+	/** if frozen: numElements elements, each at the slot the perfect hash gives its key. 0 if not frozen */
+	KVP_STRUCT * m_frozen;
+	/** if frozen: for each of numElements buckets, the seed that places its keys, or -(slot+1) for a lone key */
+	int * m_frozenSeeds;
+
+	/** the mapped snapshot file the table is in, if it came from useSnapshot. that memory is never freed */
+	const char * m_borrowed;
+	unsigned long long m_borrowedSize;
+
+	/** not copyable. pass by pointer or reference */
+	TemplateHashMap_BASE(TemplateHashMap_BASE const &);
+	TemplateHashMap_BASE & operator=(TemplateHashMap_BASE const &);
+
+	/**
+	 * reduces the hash to the table by Fibonacci hashing: the multiply moves
+	 * every bit of the hash into the top bits, which pick the slot. this keeps
+	 * a weak custom HASHER (such as the identity) from clustering.
+	 */
+	static inline unsigned long long mixHash(unsigned long long a_hash)
+	{
+		return a_hash * 0x9E3779B97F4A7C15ull;
+	}
+	inline unsigned long long mix(KEY const & k) const { return mixHash(m_hasher(k)); }
+	inline int homeSlot(unsigned long long a_mixed) const { return (int)(a_mixed >> m_shift); }
+	inline unsigned char tagOf(unsigned long long a_mixed) const { return (unsigned char)(a_mixed >> (m_shift-8)); }
+
+	/** sets the metadata of a_slot, and its mirror past the end */
+	inline void setMeta(const int a_slot, const unsigned char a_distance, const unsigned char a_tag)
+	{
+		m_distance[a_slot] = a_distance;
+		m_tag[a_slot] = a_tag;
+		if(a_slot < __GROUP_SIZE)
+		{
+			m_distance[m_capacity+a_slot] = a_distance;
+			m_tag[m_capacity+a_slot] = a_tag;
+		}
+	}
+
+	/** @return slot of the key that has a_hash and that a_matches(key) is true for, -1 if it is not in the map */
+	template<typename MATCHES>
+	int findSlotHashed(const unsigned long long a_hash, MATCHES const & a_matches) const
+	{
+		if(!numElements)
+			return -1;
+		const unsigned long long mixed = mixHash(a_hash);
+		const unsigned char tag = tagOf(mixed);
+		const int mask = m_capacity-1;
+		int slot = homeSlot(mixed);
+#ifdef TEMPLATESCAN_SSE2
+		// lane i of a group is i slots further, so a match there must have distance+i
+		const __m128i lanes = _mm_setr_epi8(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15);
+		const __m128i tags = _mm_set1_epi8((char)tag);
+		for(int distance = 1; distance <= __MAX_PROBE; distance += __GROUP_SIZE)
+		{
+			const __m128i expected = _mm_add_epi8(_mm_set1_epi8((char)distance), lanes);
+			const __m128i d = _mm_loadu_si128((__m128i const*)(m_distance+slot));
+			const __m128i t = _mm_loadu_si128((__m128i const*)(m_tag+slot));
+			unsigned int matches = (unsigned int)_mm_movemask_epi8(
+				_mm_and_si128(_mm_cmpeq_epi8(t, tags), _mm_cmpeq_epi8(d, expected)));
+			// robin hood: a slot closer to its home than expected ends the search
+			unsigned int stop = ~(unsigned int)_mm_movemask_epi8(
+				_mm_cmpeq_epi8(_mm_max_epu8(d, expected), d)) & 0xffff;
+			if(stop)
+				matches &= (1u << TemplateScan::lowestBit(stop)) - 1;
+			while(matches)
+			{
+				const int found = (slot + TemplateScan::lowestBit(matches)) & mask;
+				if(a_matches(m_slots[found].k))
+					return found;
+				matches &= matches-1;
+			}
+			if(stop)
+				return -1;
+			slot = (slot + __GROUP_SIZE) & mask;
+		}
+#else
+		for(int distance = 1; distance <= __MAX_PROBE; ++distance)
+		{
+			const int d = m_distance[slot];
+			if(d < distance)
+				return -1;
+			if(d == distance && m_tag[slot] == tag && a_matches(m_slots[slot].k))
+				return slot;
+			slot = (slot+1) & mask;
+		}
+#endif
+		return -1;
+	}
+
+	/** matches keys equal to the given one */
+	struct MatchesKey
+	{
+		KEY const & key;
+		MatchesKey(KEY const & a_key):key(a_key){}
+		inline bool operator()(KEY const & a_key) const { return KVP_STRUCT::keyEquals(a_key, key); }
+	};
+
+	/** @return slot of the given key, -1 if it is not in the map */
+	inline int findSlot(KEY const & k) const
+	{
+		return findSlotHashed(m_hasher(k), MatchesKey(k));
+	}
+
+	/**
+	 * @return true if an element that hashes to a_mixed can be inserted
+	 * without any element getting too far from home. walks the slots
+	 * insertNew would, without moving anything
+	 */
+	bool fits(const unsigned long long a_mixed) const
+	{
+		const int mask = m_capacity-1;
+		int slot = homeSlot(a_mixed);
+		for(int distance = 1; distance <= __MAX_PROBE; ++distance)
+		{
+			const int d = m_distance[slot];
+			if(!d)
+				return true;
+			if(d < distance)
+				distance = d;
+			slot = (slot+1) & mask;
+		}
+		return false;
+	}
+
+	/**
+	 * robin hood insert of an element whose key is not in the map yet
+	 * @return false if an element got too far from home. a_element is then
+	 * the element left without a slot. place checks first, to avoid this
+	 */
+	bool insertNew(KVP_STRUCT & a_element, unsigned long long a_mixed)
+	{
+		const int mask = m_capacity-1;
+		int slot = homeSlot(a_mixed);
+		unsigned char tag = tagOf(a_mixed);
+		for(int distance = 1; distance <= __MAX_PROBE; ++distance)
+		{
+			const int d = m_distance[slot];
+			if(!d)
+			{
+#ifdef CPP11_HAS_MOVE_SEMANTICS
+				new (m_slots+slot) KVP_STRUCT(std::move(a_element));
+#else
+				new (m_slots+slot) KVP_STRUCT(a_element);
+#endif
+				setMeta(slot, (unsigned char)distance, tag);
+				if(distance > m_mostDistance)
+					m_mostDistance = distance;
+				return true;
+			}
+			if(d < distance)
+			{
+				// take from the rich: the resident is closer to home, so it moves on
+				std::swap(m_slots[slot], a_element);
+				const unsigned char residentTag = m_tag[slot];
+				setMeta(slot, (unsigned char)distance, tag);
+				if(distance > m_mostDistance)
+					m_mostDistance = distance;
+				tag = residentTag;
+				distance = d;
+			}
+			slot = (slot+1) & mask;
+		}
+		return false;
+	}
+
+	/** @return m_shift for a table of a_capacity slots */
+	static int shiftFor(const int a_capacity)
+	{
+		int shift = 64;
+		for(int c = a_capacity; c > 1; c >>= 1)
+			--shift;
+		return shift;
+	}
+
+	/** the table's layout, for TemplateHashMapSnapshot (the macros are undefined after the class) */
+	enum { GROUP_SIZE = __GROUP_SIZE, MAX_PROBE = __MAX_PROBE };
+
+	/** @return how many bytes of metadata (probe distances, then tags) a table of a_capacity slots has */
+	static inline unsigned long long metaSizeFor(const unsigned long long a_capacity)
+	{
+		return a_capacity ? (a_capacity+__GROUP_SIZE)*2 : 0;
+	}
+
+	/** frees table memory, unless it is part of a snapshot the table is used from */
+	template<typename TYPE>
+	void freeTableMemory(TYPE *& a_memory)
+	{
+		const char * memory = (const char *)a_memory;
+		if(m_borrowedSize && memory >= m_borrowed && memory < m_borrowed+m_borrowedSize)
+			a_memory = 0;
+		else
+			DELMEM_CLEAN_ARR(a_memory);
+	}
+
+	/**
+	 * works out the probe distances that robin hood inserts of a_elements[0]
+	 * to a_elements[a_count-1] would give in a table of a_capacity slots, in
+	 * a_distance, which starts zeroed. elements whose a_live is 0 are skipped
+	 * (all are inserted if a_live is 0)
+	 * @return false if an element would get too far from home
+	 */
+	bool fitsAll(unsigned char * a_distance, const int a_capacity,
+		KVP_STRUCT const * a_elements, unsigned char const * a_live, const int a_count) const
+	{
+		const int mask = a_capacity-1;
+		const int shift = shiftFor(a_capacity);
+		for(int i = 0; i < a_count; ++i)
+		{
+			if(a_live && !a_live[i])
+				continue;
+			int slot = (int)(mix(a_elements[i].k) >> shift);
+			int distance = 1;
+			for(;;)
+			{
+				if(distance > __MAX_PROBE)
+					return false;
+				const int d = a_distance[slot];
+				if(!d || d < distance)
+				{
+					a_distance[slot] = (unsigned char)distance;
+					if(!d)
+						break;
+					distance = d;
+				}
+				slot = (slot+1) & mask;
+				++distance;
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * moves a_elements[0] to a_elements[a_count-1] (those whose a_live is not
+	 * 0, if there is a_live) into a new table of a_capacity slots (a power of
+	 * 2), which doubles until no element is too far from home in it. frees
+	 * the old table. a_elements is left destroyed, for the caller to free
+	 * @param a_fits true if the caller knows no element gets too far from
+	 * home in a table of a_capacity slots, so that is not checked
+	 * @return false if memory could not be allocated, or the elements do not
+	 * fit in any table an int can count. nothing has changed then
+	 */
+	bool moveToNewTable(int a_capacity, KVP_STRUCT * a_elements, unsigned char const * a_live, const int a_count, const bool a_fits)
+	{
+		TEMPLATEHASHMAP_COUNT(m_rehashes++);
+		unsigned char * meta = 0;
+		for(;;)
+		{
+			meta = NEWMEM_ARR(unsigned char, (size_t)metaSizeFor(a_capacity));
+			if(!meta)
+				return false;
+			memset(meta, 0, (size_t)metaSizeFor(a_capacity));
+			// finding out first means a table that is too small is dropped before anything moves
+			if(a_fits || fitsAll(meta, a_capacity, a_elements, a_live, a_count))
+				break;
+			DELMEM_CLEAN_ARR(meta);
+			// keys whose hashes collide too much never fit. stop before the capacity overflows
+			if(a_capacity >= (1 << 30))
+				return false;
+			TEMPLATEHASHMAP_COUNT(m_overflowRehashes++);
+			a_capacity *= 2;
+		}
+		KVP_STRUCT * slots = (KVP_STRUCT*)NEWMEM_ARR(char, sizeof(KVP_STRUCT)*a_capacity);
+		if(!slots)
+		{
+			DELMEM_CLEAN_ARR(meta);
+			return false;
+		}
+		if(!a_fits)
+			memset(meta, 0, (size_t)metaSizeFor(a_capacity));
+		// empty slots are zero, so a snapshot of the table writes no stale memory
+		memset((void*)slots, 0, sizeof(KVP_STRUCT)*a_capacity);
+		char * oldSlotMemory = (char*)m_slots;
+		unsigned char * oldDistance = m_distance;
+		m_slots = slots;
+		m_distance = meta;
+		m_tag = meta+a_capacity+__GROUP_SIZE;
+		m_capacity = a_capacity;
+		m_shift = shiftFor(a_capacity);
+		m_mostDistance = 0;
+		for(int i = 0; i < a_count; ++i)
+		{
+			if(a_live && !a_live[i])
+				continue;
+			// fitsAll (or the caller) found that each of these fits
+			insertNew(a_elements[i], mix(a_elements[i].k));
+			a_elements[i].~KVP_STRUCT();
+		}
+		freeTableMemory(oldSlotMemory);
+		freeTableMemory(oldDistance);
+		return true;
+	}
+
+	/**
+	 * moves every element into a table with a_capacity slots (a power of 2)
+	 * @return false if memory could not be allocated. the table is then as it was
+	 */
+	bool rehash(const int a_capacity)
+	{
+		// slots are sorted by home, so growing f times takes an element at most
+		// f-1 slots further from home. then the elements need not be checked
+		const bool known = a_capacity >= m_capacity
+			&& (!m_capacity || m_mostDistance + a_capacity/m_capacity - 1 <= __MAX_PROBE);
+		// the old table's distances say which of its slots are full. they are freed last
+		return moveToNewTable(a_capacity, m_slots, m_distance, m_capacity, known);
+	}
+
+	/**
+	 * inserts an element whose key is not in the map yet, growing the table if a probe gets too long
+	 * @return false if the table could not grow. a_element is then not in the map
+	 */
+	bool place(KVP_STRUCT & a_element)
+	{
+		const unsigned long long mixed = mix(a_element.k);
+		while(m_mostDistance >= __MAX_PROBE && !fits(mixed))
+		{
+			if(m_capacity >= (1 << 30))
+				return false;
+			TEMPLATEHASHMAP_COUNT(m_overflowRehashes++);
+			bool grown = false;
+			NEWMEM_SOURCE_TRACE(grown = rehash(m_capacity*2));
+			if(!grown)
+				return false;
+		}
+		insertNew(a_element, mixed);
+		return true;
+	}
+
+	/** @return a_hash scaled to [0, a_range), using its top 32 bits */
+	static inline int reduce(unsigned long long a_hash, const int a_range)
+	{
+		return (int)(((a_hash >> 32) * (unsigned long long)a_range) >> 32);
+	}
+	/** @return which bucket of the frozen table a key with a_hash is in */
+	inline int frozenBucket(unsigned long long a_hash) const
+	{
+		return reduce(a_hash * 0x9E3779B97F4A7C15ull, numElements);
+	}
+	/** @return the frozen slot that a_seed gives a key with a_hash */
+	static inline int frozenSlot(unsigned long long a_hash, const int a_seed, const int a_count)
+	{
+		return reduce(TemplateHash::mix64(a_hash ^ ((unsigned long long)a_seed * 0xD6E8FEB86659FD93ull)), a_count);
+	}
+
+	/** @return the frozen slot of the key with a_hash that a_matches, -1 if it is not in the map. one probe */
+	template<typename MATCHES>
+	int findFrozenSlot(const unsigned long long a_hash, MATCHES const & a_matches) const
+	{
+		const int seed = m_frozenSeeds[frozenBucket(a_hash)];
+		const int slot = (seed < 0) ? (-seed-1) : frozenSlot(a_hash, seed, numElements);
+		return a_matches(m_frozen[slot].k) ? slot : -1;
+	}
+
+	/** @return the element with the given key, 0 if it is not in the map */
+	inline KVP_STRUCT * find(KEY const & k) const
+	{
+		return findHashed(m_hasher(k), MatchesKey(k));
+	}
+
+	/** destroys and frees the frozen table, if there is one */
+	void releaseFrozen()
+	{
+		if(!m_frozen)
+			return;
+		for(int i = 0; i < numElements; ++i)
+			m_frozen[i].~KVP_STRUCT();
+		char * frozenMemory = (char*)m_frozen;
+		freeTableMemory(frozenMemory);
+		freeTableMemory(m_frozenSeeds);
+		m_frozen = 0;
+		numElements = 0;
+	}
+
+	/** destroys the elements of the probing table, keeping its memory */
+	void clearTable()
+	{
+		for(int i = 0; i < m_capacity; ++i)
+		{
+			if(m_distance[i])
+				m_slots[i].~KVP_STRUCT();
+		}
+		if(m_capacity)
+			memset(m_distance, 0, m_capacity+__GROUP_SIZE);
+		m_mostDistance = 0;
+		numElements = 0;
+	}
+
+protected:
+	/**
+	 * finds a key without having a KEY to look it up with, for lookups by
+	 * something that compares and hashes like a KEY
+	 * @param a_hash what the HASHER would return for the key
+	 * @param a_matches a_matches(key) returns true for the key being looked up
+	 * @return the element, 0 if it is not in the map
+	 */
+	template<typename MATCHES>
+	KVP_STRUCT * findHashed(const unsigned long long a_hash, MATCHES const & a_matches) const
+	{
+		TEMPLATEHASHMAP_COUNT(m_lookups++);
+		if(m_frozen)
+		{
+			int slot = findFrozenSlot(a_hash, a_matches);
+			TEMPLATEHASHMAP_COUNT(m_hits += (slot >= 0));
+			return (slot < 0) ? 0 : (m_frozen+slot);
+		}
+		int slot = findSlotHashed(a_hash, a_matches);
+		TEMPLATEHASHMAP_COUNT(m_hits += (slot >= 0));
+		return (slot < 0) ? 0 : (m_slots+slot);
+	}
+private:
+
+	/** @return a power of 2 capacity that holds a_count elements under the max load factor */
+	int capacityFor(const int a_count) const
+	{
+		int capacity = __GROUP_SIZE;
+		while(a_count > (int)(capacity * m_maxLoadFactor))
+			capacity *= 2;
+		return capacity;
+	}
 public:
 	int elementCount(){return numElements;}
 
+	/** @return how many key/value pairs are in the map */
+	inline int size() const { return numElements; }
+
+	/** @return the functor that hashes keys */
+	inline HASHER const & getHasher() const { return m_hasher; }
+
+	/** @return how many slots the table has */
+	inline int capacity() const { return m_capacity; }
+
+	/** @return how full the table may get before it grows, between 0 and 1 */
+	inline float getMaxLoadFactor() const { return m_maxLoadFactor; }
+
+	/**
+	 * @param a_maxLoadFactor how full the table may get before it grows.
+	 * higher saves memory, lower keeps probes shorter. clamped to [0.25, 0.95]
+	 */
+	void setMaxLoadFactor(float a_maxLoadFactor)
+	{
+		if(a_maxLoadFactor < 0.25f)	a_maxLoadFactor = 0.25f;
+		if(a_maxLoadFactor > 0.95f)	a_maxLoadFactor = 0.95f;
+		m_maxLoadFactor = a_maxLoadFactor;
+		if(m_capacity && numElements > (int)(m_capacity * m_maxLoadFactor))
+			rehash(capacityFor(numElements));
+	}
+
+	/** removes every element, keeping the table's memory (a frozen table is freed) */
 	void clear(){
-		for(int i = 0; i < hash.size(); ++i)
-			hash.get(i).clear();
-		numElements = 0;
+		releaseFrozen();
+		clearTable();
 	}
-	TemplateHashMap_BASE():numElements(0)
+	TemplateHashMap_BASE(HASHER const & a_hasher = HASHER())
+		:m_slots(0),m_distance(0),m_tag(0),m_capacity(0),m_shift(64),m_mostDistance(0),
+		m_maxLoadFactor(__DEFAULT_MAX_LOAD_FACTOR),numElements(0),m_hasher(a_hasher),
+		m_frozen(0),m_frozenSeeds(0),m_borrowed(0),m_borrowedSize(0)
 	{
-		hash.setSize(__DEFAULT_BUCKET_SIZE);
-		for(int i = 0; i < hash.size(); ++i){
-			TemplateVector<KVP_STRUCT> * hashBucket = NEWMEM(TemplateVector<KVP_STRUCT>());
-			hash.set(i, hashBucket);
-			hash.get(i)->init();
-		}
+		resetStats();
 	}
 	/** clears the hash table (does not delete hash elements! they had better be referenced elsewhere...) */
 	void release(){
-		for(int i = 0; i < hash.size(); ++i){
-			TemplateVector<KVP_STRUCT>* list = hash.get(i);
-			if(list){
-				DELMEM(list);
-				hash.set(i, 0);
-			}
-		}
-		hash.clear();
+		clear();
+		char * slotMemory = (char*)m_slots;
+		freeTableMemory(slotMemory);
+		freeTableMemory(m_distance);
+		m_slots = 0;
+		m_tag = 0;
+		m_capacity = 0;
+		m_shift = 64;
+		m_mostDistance = 0;
+		m_borrowed = 0;
+		m_borrowedSize = 0;
 	}
 	/** clears and deletes hash table elements (the elements had better be pointers!) */
 	void deleteAll(){
-		for(int y = 0; y < hash.size(); ++y){
-			TemplateVector<KVP_STRUCT>* list = hash.get(y);
-			for(int x = 0; x < list->size(); ++x){
-				if(list->get(x).v){
-					DELMEM(list->get(x).v);
-					list->get(x).v = 0;
-				}
+		KVP_STRUCT * elements = getRawDatabase();
+		for(int i = 0; i < getRawDatabaseSize(); ++i){
+			if(isSlotUsed(i) && elements[i].v){
+				DELMEM(elements[i].v);
+				elements[i].v = 0;
 			}
-			list->clear();
-			DELMEM(list);
-			hash.set(y, 0);
 		}
-		hash.clear();
+		release();
 	}
-	~TemplateHashMap_BASE(){release();hash.release();}
+	~TemplateHashMap_BASE(){release();}
 
 	/** @return the value associated with the given KEY */
 	VALUE * getByKey(KEY const & k)
 	{
-		int index = KVP_STRUCT::hashFunction(k);
-		TemplateVector<KVP_STRUCT> * bucket = hash.get(index);
-		KVP_STRUCT kvp(k);
-		int bucketIndex = bucket->indexOfWithBinarySearch(kvp);
-		if(bucketIndex < 0)
+		KVP_STRUCT * element = find(k);
+		if(!element)
 			return 0;
-		return &bucket->get(bucketIndex).v;
+		return &element->v;
 	}
 
-	/** sets up a key/value pair association */
-	void set(KEY const & k, VALUE const & v)
+	/** @return the value associated with the given KEY */
+	VALUE const * getByKey(KEY const & k) const
 	{
-		int index = KVP_STRUCT::hashFunction(k);
-		TemplateVector<KVP_STRUCT> * bucket = hash.get(index);
-		int indexInserted;
-		NEWMEM_SOURCE_TRACE(indexInserted = bucket->insertSorted(KVP_STRUCT(k,v), true));
-		if(indexInserted >= 0)
+		KVP_STRUCT const * element = find(k);
+		if(!element)
+			return 0;
+		return &element->v;
+	}
+
+	/**
+	 * removes the given key and its value. the elements after it that are not
+	 * in their home slot move back one slot each (backward shift deletion), so
+	 * no tombstone is left behind. erasing from a frozen map thaws it
+	 * @return false if the key is not in the map, or a frozen map could not thaw
+	 */
+	bool erase(KEY const & k)
+	{
+		if(m_frozen)
+		{
+			if(!find(k))
+				return false;
+			bool thawed = false;
+			NEWMEM_SOURCE_TRACE(thawed = thaw());
+			if(!thawed)
+				return false;
+		}
+		int slot = findSlot(k);
+		if(slot < 0)
+			return false;
+		const int mask = m_capacity-1;
+		int next = (slot+1) & mask;
+		while(m_distance[next] > 1)
+		{
+#ifdef CPP11_HAS_MOVE_SEMANTICS
+			m_slots[slot] = std::move(m_slots[next]);
+#else
+			m_slots[slot] = m_slots[next];
+#endif
+			setMeta(slot, (unsigned char)(m_distance[next]-1), m_tag[next]);
+			slot = next;
+			next = (next+1) & mask;
+		}
+		m_slots[slot].~KVP_STRUCT();
+		setMeta(slot, 0, 0);
+		numElements--;
+		return true;
+	}
+
+	/**
+	 * grows the table so a_count elements fit without another rehash. call it
+	 * before a bulk load. never shrinks. thaws a frozen map
+	 * @return false if memory could not be allocated. the map is then as it was
+	 */
+	bool reserve(const int a_count)
+	{
+		bool allocated = false;
+		NEWMEM_SOURCE_TRACE(allocated = thaw());
+		if(!allocated)
+			return false;
+		const int capacity = capacityFor(a_count);
+		if(capacity > m_capacity)
+		{
+			NEWMEM_SOURCE_TRACE(allocated = rehash(capacity));
+		}
+		return allocated;
+	}
+
+	/**
+	 * sets up a key/value pair association, replacing the key's old value. adding a key thaws a frozen map
+	 * @return false if memory could not be allocated. the map is then as it was
+	 */
+	bool set(KEY const & k, VALUE const & v)
+	{
+		KVP_STRUCT * found = find(k);
+		if(found)
+		{
+			found->v = v;
+			return true;
+		}
+		bool allocated = false;
+		NEWMEM_SOURCE_TRACE(allocated = thaw());
+		if(!allocated)
+			return false;
+		if(numElements+1 > (int)(m_capacity * m_maxLoadFactor))
+		{
+			NEWMEM_SOURCE_TRACE(allocated = rehash(capacityFor(numElements+1)));
+			if(!allocated)
+				return false;
+		}
+		KVP_STRUCT element(k,v);
+		NEWMEM_SOURCE_TRACE(allocated = place(element));
+		if(!allocated)
+			return false;
+		numElements++;
+		return true;
+	}
+
+	/** @param a_stats filled with the probe lengths of the elements now, and the counters if TEMPLATEHASHMAP_STATS is defined */
+	void getStats(TemplateHashMapStats & a_stats) const
+	{
+		memset(&a_stats, 0, sizeof(a_stats));
+		a_stats.size = numElements;
+		a_stats.capacity = getRawDatabaseSize();
+		a_stats.loadFactor = a_stats.capacity ? (float)numElements / a_stats.capacity : 0;
+		long long totalProbe = 0;
+		if(m_frozen)
+		{
+			// every key is one probe away
+			a_stats.probeHistogram[1] = numElements;
+			a_stats.maxProbe = numElements ? 1 : 0;
+			totalProbe = numElements;
+		}
+		for(int i = 0; !m_frozen && i < m_capacity; ++i)
+		{
+			const int probe = m_distance[i];
+			if(!probe)
+				continue;
+			a_stats.probeHistogram[probe]++;
+			if(probe > a_stats.maxProbe)
+				a_stats.maxProbe = probe;
+			totalProbe += probe;
+		}
+		a_stats.meanProbe = numElements ? (float)totalProbe / numElements : 0;
+		// linear probing with random hashes averages (1 + 1/(1-load))/2 probes to find a key
+		a_stats.expectedMeanProbe = (m_frozen || !numElements) ? a_stats.meanProbe
+			: (1 + 1 / (1 - a_stats.loadFactor)) / 2;
+#ifdef TEMPLATEHASHMAP_STATS
+		a_stats.lookups = m_lookups;
+		a_stats.hits = m_hits;
+		a_stats.misses = m_lookups - m_hits;
+		a_stats.rehashes = m_rehashes;
+		a_stats.overflowRehashes = m_overflowRehashes;
+#endif
+	}
+
+	/** zeroes the lookup and rehash counters */
+	void resetStats()
+	{
+#ifdef TEMPLATEHASHMAP_STATS
+		m_lookups = m_hits = 0;
+		m_rehashes = m_overflowRehashes = 0;
+#endif
+	}
+
+	/**
+	 * prints getStats to stdout. a mean probe well above the expected one, or
+	 * any overflow rehashes, means the HASHER is clustering keys
+	 */
+	void reportStats() const
+	{
+		TemplateHashMapStats stats;
+		getStats(stats);
+		printf("%d elements in %d slots (load %.3f)%s\n", stats.size, stats.capacity,
+			stats.loadFactor, m_frozen ? ", frozen" : "");
+		printf("probe: mean %.3f (expected %.3f), max %d\n", stats.meanProbe,
+			stats.expectedMeanProbe, stats.maxProbe);
+		printf(" probe  elements\n");
+		for(int i = 1; i <= stats.maxProbe; ++i)
+		{
+			if(stats.probeHistogram[i])
+				printf("%6d  %8d\n", i, stats.probeHistogram[i]);
+		}
+#ifdef TEMPLATEHASHMAP_STATS
+		printf("%lld lookups: %lld hits, %lld misses\n", stats.lookups, stats.hits, stats.misses);
+		printf("%d rehashes, %d forced by long probes\n", stats.rehashes, stats.overflowRehashes);
+#endif
+	}
+
+	/** @return true if the map is a frozen minimal perfect hash */
+	inline bool isFrozen() const { return m_frozen != 0; }
+
+	/**
+	 * rebuilds the map as a minimal perfect hash (hash and displace): keys are
+	 * split into numElements buckets, and each bucket gets a seed that sends
+	 * its keys to slots no other key uses. every lookup is one hash, one seed
+	 * and one key compare, in a table with no empty slots. values can still be
+	 * changed through getByKey or set. adding a key thaws the map.
+	 * @return false if the map could not be frozen (keys with identical full
+	 * hashes, or no memory), in which case it is unchanged
+	 */
+	bool freeze()
+	{
+		if(m_frozen || !numElements)
+			return m_frozen != 0;
+		const int count = numElements;
+		// scratch, freed on return
+		TemplateArray<unsigned long long> hashes(count);
+		TemplateArray<int> source(count), bucketOf(count), bucketStart(count+1), members(count);
+		TemplateArray<int> seeds(count), placedAt(count), order(count);
+		TemplateArray<char> taken(count);
+		taken.setAll(0);
+		bucketStart.setAll(0);
+		// group the elements by bucket
+		int e = 0;
+		for(int i = 0; i < m_capacity; ++i)
+		{
+			if(!m_distance[i])
+				continue;
+			hashes[e] = m_hasher(m_slots[i].k);
+			source[e] = i;
+			bucketOf[e] = frozenBucket(hashes[e]);
+			bucketStart[bucketOf[e]+1]++;
+			++e;
+		}
+		int biggest = 0;
+		for(int b = 0; b < count; ++b)
+		{
+			if(bucketStart[b+1] > biggest)
+				biggest = bucketStart[b+1];
+			bucketStart[b+1] += bucketStart[b];
+		}
+		{
+			TemplateArray<int> cursor(count);
+			for(int b = 0; b < count; ++b)
+				cursor[b] = bucketStart[b];
+			for(e = 0; e < count; ++e)
+				members[cursor[bucketOf[e]]++] = e;
+		}
+		// biggest buckets first, while there are many free slots to pick from
+		int o = 0;
+		for(int size = biggest; size > 0; --size)
+		{
+			for(int b = 0; b < count; ++b)
+			{
+				if(bucketStart[b+1]-bucketStart[b] == size)
+					order[o++] = b;
+			}
+		}
+		// find a seed for each bucket with more than one key
+		static const int MAX_SEED = 1 << 20;
+		int firstSingle = o;
+		for(int i = 0; i < o; ++i)
+		{
+			const int b = order[i], start = bucketStart[b], end = bucketStart[b+1];
+			if(end-start == 1)
+			{
+				firstSingle = i;
+				break;
+			}
+			int seed = 1;
+			for(; seed < MAX_SEED; ++seed)
+			{
+				int m = start;
+				for(; m < end; ++m)
+				{
+					const int slot = frozenSlot(hashes[members[m]], seed, count);
+					if(taken[slot])
+						break;
+					taken[slot] = 1;
+					placedAt[members[m]] = slot;
+				}
+				if(m == end)
+					break;
+				// undo this seed's claims
+				for(int u = start; u < m; ++u)
+					taken[placedAt[members[u]]] = 0;
+			}
+			if(seed == MAX_SEED)
+				return false;
+			seeds[b] = seed;
+		}
+		// lone keys go straight into the free slots
+		int freeSlot = 0;
+		for(int i = firstSingle; i < o; ++i)
+		{
+			const int b = order[i];
+			while(taken[freeSlot])
+				++freeSlot;
+			taken[freeSlot] = 1;
+			placedAt[members[bucketStart[b]]] = freeSlot;
+			seeds[b] = -(freeSlot+1);
+		}
+		for(int b = 0; b < count; ++b)
+		{
+			if(bucketStart[b+1] == bucketStart[b])
+				seeds[b] = 0;
+		}
+		// move the elements in, and drop the probing table
+		KVP_STRUCT * frozen = (KVP_STRUCT*)NEWMEM_ARR(char, sizeof(KVP_STRUCT)*count);
+		int * frozenSeeds = NEWMEM_ARR(int, count);
+		if(!frozen || !frozenSeeds)
 		{
-			numElements++;
+			char * frozenMemory = (char*)frozen;
+			DELMEM_CLEAN_ARR(frozenMemory);
+			DELMEM_CLEAN_ARR(frozenSeeds);
+			return false;
 		}
+		m_frozen = frozen;
+		m_frozenSeeds = frozenSeeds;
+		memcpy(m_frozenSeeds, seeds.getRawListConst(), sizeof(int)*count);
+		for(e = 0; e < count; ++e)
+		{
+#ifdef CPP11_HAS_MOVE_SEMANTICS
+			new (m_frozen+placedAt[e]) KVP_STRUCT(std::move(m_slots[source[e]]));
+#else
+			new (m_frozen+placedAt[e]) KVP_STRUCT(m_slots[source[e]]);
+#endif
+		}
+		clearTable();
+		char * slotMemory = (char*)m_slots;
+		freeTableMemory(slotMemory);
+		freeTableMemory(m_distance);
+		m_slots = 0;
+		m_tag = 0;
+		m_capacity = 0;
+		m_shift = 64;
+		m_mostDistance = 0;
+		numElements = count;
+		return true;
 	}
-	/** @return the structure that does all the work for the hash map */
-	TemplateVector<TemplateVector<KVP_STRUCT>*> * getRawDatabase(){
-		return hash;
+
+	/**
+	 * turns a frozen map back into a regular one, that keys can be added to
+	 * @return false if memory could not be allocated. the map is then still frozen
+	 */
+	bool thaw()
+	{
+		if(!m_frozen)
+			return true;
+		bool moved = false;
+		NEWMEM_SOURCE_TRACE(moved = moveToNewTable(capacityFor(numElements), m_frozen, 0, numElements, false));
+		if(!moved)
+			return false;
+		char * frozenMemory = (char*)m_frozen;
+		freeTableMemory(frozenMemory);
+		freeTableMemory(m_frozenSeeds);
+		m_frozen = 0;
+		m_frozenSeeds = 0;
+		return true;
 	}
-#undef __DEFAULT_BUCKET_SIZE
+
+	/**
+	 * forward iterator over the elements (KVP_STRUCTs) in slot order, which is
+	 * no particular key order. it walks the byte array of probe distances,
+	 * not the elements, to skip empty slots. adding or erasing a key
+	 * invalidates it; changing values does not
+	 */
+	template<typename VALUE_TYPE>
+	class IteratorBase
+	{
+		VALUE_TYPE * m_slots;
+		/** probe distances of the slots, 0 if every slot is used (frozen) */
+		const unsigned char * m_used;
+		int m_index, m_end;
+
+		/** moves m_index forward to the next used slot, or m_end */
+		void skipEmpty()
+		{
+			if(!m_used)
+				return;
+#ifdef TEMPLATESCAN_SSE2
+			// the distance array is mirrored __GROUP_SIZE bytes past the end, so a whole group can always be read
+			const __m128i zero = _mm_setzero_si128();
+			while(m_index < m_end)
+			{
+				const unsigned int used = ~(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(
+					_mm_loadu_si128((__m128i const*)(m_used+m_index)), zero)) & 0xffff;
+				if(used)
+				{
+					m_index += TemplateScan::lowestBit(used);
+					break;
+				}
+				m_index += __GROUP_SIZE;
+			}
+			if(m_index > m_end)
+				m_index = m_end;
+#else
+			while(m_index < m_end && !m_used[m_index])
+				++m_index;
+#endif
+		}
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef VALUE_TYPE value_type;
+		typedef ptrdiff_t difference_type;
+		typedef VALUE_TYPE * pointer;
+		typedef VALUE_TYPE & reference;
+
+		IteratorBase(VALUE_TYPE * a_slots = 0, const unsigned char * a_used = 0, const int a_index = 0, const int a_end = 0)
+			:m_slots(a_slots),m_used(a_used),m_index(a_index),m_end(a_end){ skipEmpty(); }
+		/** allows iterator to become const_iterator */
+		template<typename OTHER>
+		IteratorBase(IteratorBase<OTHER> const & a_other)
+			:m_slots(a_other.slots()),m_used(a_other.used()),m_index(a_other.index()),m_end(a_other.endIndex()){}
+		VALUE_TYPE * slots() const { return m_slots; }
+		const unsigned char * used() const { return m_used; }
+		int index() const { return m_index; }
+		int endIndex() const { return m_end; }
+
+		reference operator*() const { return m_slots[m_index]; }
+		pointer operator->() const { return m_slots+m_index; }
+		IteratorBase & operator++() { ++m_index; skipEmpty(); return *this; }
+		IteratorBase operator++(int) { IteratorBase old(*this); ++(*this); return old; }
+		bool operator==(IteratorBase const & a_other) const { return m_index == a_other.m_index; }
+		bool operator!=(IteratorBase const & a_other) const { return m_index != a_other.m_index; }
+	};
+	typedef IteratorBase<KVP_STRUCT> iterator;
+	typedef IteratorBase<const KVP_STRUCT> const_iterator;
+	typedef KVP_STRUCT value_type;
+
+	/** @return iterator at the first element */
+	inline iterator begin() { return iterator(getRawDatabase(), m_frozen ? 0 : m_distance, 0, getRawDatabaseSize()); }
+	inline iterator end() { return iterator(getRawDatabase(), 0, getRawDatabaseSize(), getRawDatabaseSize()); }
+	inline const_iterator begin() const { return const_iterator(m_frozen ? m_frozen : m_slots, m_frozen ? 0 : m_distance, 0, getRawDatabaseSize()); }
+	inline const_iterator end() const { return const_iterator(m_frozen ? m_frozen : m_slots, 0, getRawDatabaseSize(), getRawDatabaseSize()); }
+
+	/**
+	 * @return the structure that does all the work for the hash map: an array
+	 * of getRawDatabaseSize() slots. only slots where isSlotUsed is true hold elements
+	 */
+	KVP_STRUCT * getRawDatabase(){
+		return m_frozen ? m_frozen : m_slots;
+	}
+	/** @return how many slots getRawDatabase has */
+	int getRawDatabaseSize() const { return m_frozen ? numElements : m_capacity; }
+	/** @return true if the slot at a_index of getRawDatabase holds an element */
+	bool isSlotUsed(const int a_index) const { return m_frozen || m_distance[a_index] != 0; }
+#undef TEMPLATEHASHMAP_COUNT
+#undef __GROUP_SIZE
+#undef __MAX_PROBE
+#undef __DEFAULT_MAX_LOAD_FACTOR
 };
 
-template <class KEY, class VALUE>
-class TemplateHashMap : public TemplateHashMap_BASE<KEY, VALUE, KeyValuePair<KEY,VALUE> >{};
+/** @param HASHER a functor returning a full-width size_t hash of a KEY */
+template <class KEY, class VALUE, class HASHER = TemplateHasher<KEY> >
+class TemplateHashMap : public TemplateHashMap_BASE<KEY, VALUE, KeyValuePair<KEY,VALUE>, HASHER >
+{
+public:
+	TemplateHashMap(HASHER const & a_hasher = HASHER())
+		:TemplateHashMap_BASE<KEY, VALUE, KeyValuePair<KEY,VALUE>, HASHER >(a_hasher){}
+};
 
-template <class VALUE>
-class TemplateHashMapNamed : public TemplateHashMap_BASE<const char*, VALUE, NameValuePair<VALUE> >{};
+/**
+ * keys are null-terminated strings, which the map points at but does not copy.
+ * they can also be looked up by a (pointer, length) slice or a TemplatedString,
+ * which need no terminator, with no copy and no strlen.
+ * @param HASHER a functor returning a full-width size_t hash of a null-terminated
+ * string. the slice lookups also need it to hash (pointer, length) the same way
+ * (see TemplateStringHasher)
+ */
+template <class VALUE, class HASHER = TemplateStringHasher>
+class TemplateHashMapNamed : public TemplateHashMap_BASE<const char*, VALUE, NameValuePair<VALUE>, HASHER >
+{
+	typedef TemplateHashMap_BASE<const char*, VALUE, NameValuePair<VALUE>, HASHER > BASE;
+
+	/** matches the key that is the same as a slice of characters */
+	struct MatchesSlice
+	{
+		const char * data;
+		int length;
+		MatchesSlice(const char * a_data, const int a_length):data(a_data),length(a_length){}
+		inline bool operator()(const char * const & a_key) const { return NameValuePair<VALUE>::keyEquals(a_key, data, length); }
+	};
+public:
+	TemplateHashMapNamed(HASHER const & a_hasher = HASHER())
+		:BASE(a_hasher){}
+
+	using BASE::getByKey;
+
+	/** @return the key/value pair whose key is the a_length characters at a_key (not null-terminated), 0 if there is none */
+	NameValuePair<VALUE> * getPairByKey(const char * a_key, const int a_length) const
+	{
+		return BASE::findHashed(this->getHasher()(a_key, a_length), MatchesSlice(a_key, a_length));
+	}
+
+	/** @return the value associated with the a_length characters at a_key (not null-terminated) */
+	VALUE * getByKey(const char * a_key, const int a_length)
+	{
+		NameValuePair<VALUE> * element = getPairByKey(a_key, a_length);
+		return element ? &element->v : 0;
+	}
+	/** @return the value associated with the a_length characters at a_key (not null-terminated) */
+	VALUE const * getByKey(const char * a_key, const int a_length) const
+	{
+		NameValuePair<VALUE> const * element = getPairByKey(a_key, a_length);
+		return element ? &element->v : 0;
+	}
+
+	/** @return the value associated with the given string */
+	template<typename CHAR>
+	VALUE * getByKey(TemplatedString<CHAR> const & a_key)
+	{
+		return getByKey(a_key.begin(), a_key.length());
+	}
+	/** @return the value associated with the given string */
+	template<typename CHAR>
+	VALUE const * getByKey(TemplatedString<CHAR> const & a_key) const
+	{
+		return getByKey(a_key.begin(), a_key.length());
+	}
+};
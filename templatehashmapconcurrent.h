@@ -0,0 +1,211 @@
+#pragma once
+
+#include "license.txt"
+#include "templatehashmap.h"
+
+#include <atomic>
+#include <thread>	// std::this_thread::yield
+
+/**
+ * a reader/writer spin lock: many readers at once, or one writer. a waiting
+ * writer stops new readers from coming in, so writers are not starved.
+ * spins briefly, then yields the thread.
+ */
+class TemplateReaderWriterLock
+{
+	/** count of readers in the low bits, plus the WRITER and WAITING flags */
+	std::atomic<unsigned int> m_state;
+	static const unsigned int WRITER = 1u << 31;
+	static const unsigned int WAITING = 1u << 30;
+
+	/** not copyable */
+	TemplateReaderWriterLock(TemplateReaderWriterLock const &);
+	TemplateReaderWriterLock & operator=(TemplateReaderWriterLock const &);
+
+	static inline void backOff(const int a_attempt)
+	{
+		if(a_attempt > 16)
+			std::this_thread::yield();
+	}
+public:
+	TemplateReaderWriterLock():m_state(0){}
+
+	void lockShared()
+	{
+		for(int attempt = 0; ; ++attempt)
+		{
+			unsigned int state = m_state.load(std::memory_order_relaxed);
+			if(!(state & (WRITER | WAITING))
+			&& m_state.compare_exchange_weak(state, state+1, std::memory_order_acquire, std::memory_order_relaxed))
+				return;
+			backOff(attempt);
+		}
+	}
+	void unlockShared()
+	{
+		m_state.fetch_sub(1, std::memory_order_release);
+	}
+	void lock()
+	{
+		for(int attempt = 0; ; ++attempt)
+		{
+			unsigned int state = m_state.load(std::memory_order_relaxed);
+			if(!(state & ~WAITING))
+			{
+				if(m_state.compare_exchange_weak(state, WRITER, std::memory_order_acquire, std::memory_order_relaxed))
+					return;
+			}
+			else if(!(state & WAITING))
+			{
+				m_state.compare_exchange_weak(state, state | WAITING, std::memory_order_relaxed, std::memory_order_relaxed);
+			}
+			backOff(attempt);
+		}
+	}
+	void unlock()
+	{
+		m_state.fetch_and(~WRITER, std::memory_order_release);
+	}
+};
+
+/**
+ * a hash map that many threads can read and write at once. keys are spread
+ * over SHARD_COUNT TemplateHashMaps, each with its own reader/writer lock, so
+ * threads only contend when they touch the same shard, and readers of a
+ * shard don't block each other.
+ *
+ * values are copied out rather than pointed to, since another thread could
+ * move them at any time. updateByKey changes a value in place, under the
+ * shard's lock.
+ * @note USE_CUSTOM_MEMORY_MANAGEMENT needs USE_CUSTOM_MEMORY_MANAGEMENT_THREADS
+ * to be used with this map.
+ * @param SHARD_COUNT how many independently locked maps. a power of 2
+ */
+template <class KEY, class VALUE, class HASHER = TemplateHasher<KEY>, int SHARD_COUNT = 64>
+class TemplateHashMapConcurrent
+{
+	/** a map and its lock, padded to its own cache lines so shards don't false-share */
+	struct Shard
+	{
+		TemplateReaderWriterLock lock;
+		TemplateHashMap<KEY, VALUE, HASHER> map;
+		char padding[64];
+		Shard(HASHER const & a_hasher):map(a_hasher){}
+	};
+	Shard * m_shards[SHARD_COUNT];
+	HASHER m_hasher;
+
+	/** not copyable */
+	TemplateHashMapConcurrent(TemplateHashMapConcurrent const &);
+	TemplateHashMapConcurrent & operator=(TemplateHashMapConcurrent const &);
+
+	/**
+	 * each shard's map picks slots with the top bits of the hash, so the shard
+	 * is picked from a re-mix of it, to keep the two choices independent
+	 */
+	inline Shard & shardOf(KEY const & k) const
+	{
+		return *m_shards[TemplateHash::mix64(m_hasher(k)) & (SHARD_COUNT-1)];
+	}
+public:
+	TemplateHashMapConcurrent(HASHER const & a_hasher = HASHER()):m_hasher(a_hasher)
+	{
+		for(int i = 0; i < SHARD_COUNT; ++i)
+			m_shards[i] = NEWMEM(Shard(a_hasher));
+	}
+	~TemplateHashMapConcurrent()
+	{
+		for(int i = 0; i < SHARD_COUNT; ++i)
+			DELMEM_CLEAN(m_shards[i]);
+	}
+
+	/**
+	 * @param a_value where to copy the value associated with k
+	 * @return false if k is not in the map (a_value is not changed)
+	 */
+	bool getByKey(KEY const & k, VALUE & a_value) const
+	{
+		Shard & shard = shardOf(k);
+		shard.lock.lockShared();
+		VALUE const * found = shard.map.getByKey(k);
+		if(found)
+			a_value = *found;
+		shard.lock.unlockShared();
+		return found != 0;
+	}
+
+	/** @return true if k is in the map */
+	bool containsKey(KEY const & k) const
+	{
+		Shard & shard = shardOf(k);
+		shard.lock.lockShared();
+		bool found = shard.map.getByKey(k) != 0;
+		shard.lock.unlockShared();
+		return found;
+	}
+
+	/**
+	 * sets up a key/value pair association, replacing the key's old value
+	 * @return false if memory could not be allocated. the map is then as it was
+	 */
+	bool set(KEY const & k, VALUE const & v)
+	{
+		Shard & shard = shardOf(k);
+		shard.lock.lock();
+		bool added = false;
+		NEWMEM_SOURCE_TRACE(added = shard.map.set(k, v));
+		shard.lock.unlock();
+		return added;
+	}
+
+	/** @return false if k was not in the map */
+	bool erase(KEY const & k)
+	{
+		Shard & shard = shardOf(k);
+		shard.lock.lock();
+		bool erased = shard.map.erase(k);
+		shard.lock.unlock();
+		return erased;
+	}
+
+	/**
+	 * @param f called as f(value) with the value of k, while no other thread
+	 * can touch that value. keep it short: it blocks the whole shard
+	 * @return false if k is not in the map (f is not called)
+	 */
+	template<typename FUNCTION>
+	bool updateByKey(KEY const & k, FUNCTION f)
+	{
+		Shard & shard = shardOf(k);
+		shard.lock.lock();
+		VALUE * found = shard.map.getByKey(k);
+		if(found)
+			f(*found);
+		shard.lock.unlock();
+		return found != 0;
+	}
+
+	/** @return how many key/value pairs are in the map. only a snapshot if other threads are writing */
+	int size() const
+	{
+		int count = 0;
+		for(int i = 0; i < SHARD_COUNT; ++i)
+		{
+			m_shards[i]->lock.lockShared();
+			count += m_shards[i]->map.size();
+			m_shards[i]->lock.unlockShared();
+		}
+		return count;
+	}
+
+	/** removes every element, keeping memory */
+	void clear()
+	{
+		for(int i = 0; i < SHARD_COUNT; ++i)
+		{
+			m_shards[i]->lock.lock();
+			m_shards[i]->map.clear();
+			m_shards[i]->lock.unlock();
+		}
+	}
+};
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "license.txt"
+#include "templatehashmap.h"
+#include "templatesnapshot.h"
+
+/**
+ * saves a TemplateHashMap (or TemplateHashMapNamed...) as a snapshot file,
+ * and uses one right where it is in a mapped file. kept out of
+ * templatehashmap.h, so only code that uses snapshots includes the OS
+ * headers for mapping files.
+ */
+struct TemplateHashMapSnapshot
+{
+	/**
+	 * saves the table as a snapshot file (see TemplateSnapshotHeader), in one
+	 * sequential write. the file is the table's memory as it is, frozen or not,
+	 * so `use` can map it without rebuilding it.
+	 * KEY and VALUE must be bitwise copyable and hold no pointers, and the
+	 * HASHER must hash the same in the program that loads it (TemplateHasher does)
+	 * @return false if the file could not be written
+	 */
+	template <class KEY, class VALUE, class KVP_STRUCT, class HASHER>
+	static bool save(TemplateHashMap_BASE<KEY, VALUE, KVP_STRUCT, HASHER> const & a_map, const char * a_filename)
+	{
+#ifdef CPP11_HAS_TYPE_TRAITS
+		static_assert(TemplateArrayIsBitwiseCopyable<KVP_STRUCT>::value, "snapshots hold bitwise copies of elements");
+#endif
+		TemplateSnapshotHeader header;
+		const void * arrays[2];
+		if(a_map.m_frozen)
+		{
+			header.init(TemplateSnapshotHeader::HASHMAP_FROZEN, sizeof(KVP_STRUCT), a_map.numElements);
+			header.addArray(0, (unsigned long long)sizeof(KVP_STRUCT) * a_map.numElements);
+			header.addArray(1, (unsigned long long)sizeof(int) * a_map.numElements);
+			arrays[0] = a_map.m_frozen;
+			arrays[1] = a_map.m_frozenSeeds;
+		}
+		else
+		{
+			header.init(TemplateSnapshotHeader::HASHMAP, sizeof(KVP_STRUCT), a_map.numElements);
+			header.addArray(0, (unsigned long long)sizeof(KVP_STRUCT) * a_map.m_capacity);
+			header.addArray(1, a_map.metaSizeFor(a_map.m_capacity));
+			arrays[0] = a_map.m_slots;
+			arrays[1] = a_map.m_distance;
+		}
+		header.capacity = a_map.m_capacity;
+		header.maxLoadFactor = a_map.m_maxLoadFactor;
+		return header.write(a_filename, arrays, 2);
+	}
+
+	/**
+	 * replaces the map's contents with a snapshot from save, used right where
+	 * it is in the mapped file: nothing is parsed or copied, and pages of the
+	 * table are only read from disk as lookups touch them.
+	 * the map can still be changed. changes go to private copies of the
+	 * mapped pages, and growing the table moves it into memory of its own.
+	 * the file is checked before it is used, so a truncated or corrupt one
+	 * can't send lookups outside of it: the header's array sizes must match
+	 * the mapped file, and the table's metadata (or the frozen seeds), which
+	 * is small next to the elements, is read through once
+	 * @param a_file must stay open until the map is released or destroyed
+	 * @return false if a_file is not a snapshot of this kind of map, in which
+	 * case the map is unchanged
+	 */
+	template <class KEY, class VALUE, class KVP_STRUCT, class HASHER>
+	static bool use(TemplateHashMap_BASE<KEY, VALUE, KVP_STRUCT, HASHER> & a_map, TemplateMappedFile const & a_file)
+	{
+		typedef TemplateHashMap_BASE<KEY, VALUE, KVP_STRUCT, HASHER> MAP;
+		const int elementSize = sizeof(KVP_STRUCT);
+		TemplateSnapshotHeader const * header = TemplateSnapshotHeader::check(a_file.data(), a_file.size(),
+			TemplateSnapshotHeader::HASHMAP, elementSize);
+		const bool frozen = !header;
+		if(frozen)
+			header = TemplateSnapshotHeader::check(a_file.data(), a_file.size(),
+				TemplateSnapshotHeader::HASHMAP_FROZEN, elementSize);
+		if(!header)
+			return false;
+		if(header->capacity < 0 || !(header->maxLoadFactor >= 0.25f && header->maxLoadFactor <= 0.95f))
+			return false;
+		const unsigned long long count = header->count, capacity = header->capacity;
+		char * data = a_file.data();
+		int mostDistance = 0;
+		if(frozen)
+		{
+			if(!count || header->size[0] != count*elementSize || header->size[1] != count*sizeof(int))
+				return false;
+			// a lone key's seed is -(slot+1). other seeds are hashed into [0, count)
+			int const * seeds = (int const *)(data + header->offset[1]);
+			for(unsigned long long i = 0; i < count; ++i)
+			{
+				if(seeds[i] < -(int)count)
+					return false;
+			}
+		}
+		else
+		{
+			if((capacity & (capacity-1)) || (capacity && capacity < MAP::GROUP_SIZE) || count > capacity
+			|| header->size[0] != capacity*elementSize
+			|| header->size[1] != MAP::metaSizeFor(capacity))
+				return false;
+			// probe distances in range, one used slot per element, and the mirrored group matching the first
+			unsigned char const * distance = (unsigned char const *)(data + header->offset[1]);
+			unsigned char const * tag = distance+capacity+MAP::GROUP_SIZE;
+			unsigned long long used = 0;
+			for(unsigned long long i = 0; i < capacity; ++i)
+			{
+				if(distance[i] > MAP::MAX_PROBE)
+					return false;
+				used += distance[i] != 0;
+				if(distance[i] > mostDistance)
+					mostDistance = distance[i];
+			}
+			for(unsigned long long i = 0; capacity && i < MAP::GROUP_SIZE; ++i)
+			{
+				if(distance[capacity+i] != distance[i] || tag[capacity+i] != tag[i])
+					return false;
+			}
+			if(used != count)
+				return false;
+		}
+		a_map.release();
+		a_map.m_borrowed = a_file.data();
+		a_map.m_borrowedSize = a_file.size();
+		a_map.numElements = header->count;
+		a_map.m_maxLoadFactor = header->maxLoadFactor;
+		if(frozen)
+		{
+			a_map.m_frozen = (KVP_STRUCT*)(data + header->offset[0]);
+			a_map.m_frozenSeeds = (int*)(data + header->offset[1]);
+		}
+		else if(capacity)
+		{
+			a_map.m_slots = (KVP_STRUCT*)(data + header->offset[0]);
+			a_map.m_distance = (unsigned char*)(data + header->offset[1]);
+			a_map.m_tag = a_map.m_distance+capacity+MAP::GROUP_SIZE;
+			a_map.m_capacity = (int)capacity;
+			a_map.m_shift = MAP::shiftFor(a_map.m_capacity);
+			a_map.m_mostDistance = mostDistance;
+		}
+		return true;
+	}
+};
@@ -3,6 +3,9 @@
 #include "license.txt"
 #include "mem.h"
 
+#include <iterator>	// std::forward_iterator_tag
+#include <stddef.h>	// ptrdiff_t
+
 template <class DATA_TYPE>
 class TemplateQueue
 {
@@ -27,6 +30,48 @@ public:
 	/** create an empty queue with a linked-list architecture */
 	TemplateQueue():head(0),tail(0),m_size(0){}
 
+	/** forward iterator from head to tail. VALUE is DATA_TYPE or const DATA_TYPE */
+	template<typename VALUE>
+	class IteratorBase
+	{
+		TemplateQueueNode * m_node;
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef DATA_TYPE value_type;
+		typedef ptrdiff_t difference_type;
+		typedef VALUE * pointer;
+		typedef VALUE & reference;
+
+		IteratorBase(TemplateQueueNode * a_node = 0):m_node(a_node){}
+		/** allows iterator to become const_iterator */
+		template<typename OTHER>
+		IteratorBase(IteratorBase<OTHER> const & a_other):m_node(a_other.node()){}
+		TemplateQueueNode * node() const { return m_node; }
+
+		reference operator*() const { return m_node->data; }
+		pointer operator->() const { return &m_node->data; }
+		IteratorBase & operator++() { m_node = m_node->next; return *this; }
+		IteratorBase operator++(int) { IteratorBase old(*this); m_node = m_node->next; return old; }
+		bool operator==(IteratorBase const & a_other) const { return m_node == a_other.m_node; }
+		bool operator!=(IteratorBase const & a_other) const { return m_node != a_other.m_node; }
+	};
+	typedef IteratorBase<DATA_TYPE> iterator;
+	typedef IteratorBase<const DATA_TYPE> const_iterator;
+	typedef DATA_TYPE value_type;
+
+	/** @return iterator at the head of the queue */
+	inline iterator begin() { return iterator(head); }
+	inline iterator end() { return iterator(); }
+	inline const_iterator begin() const { return const_iterator(head); }
+	inline const_iterator end() const { return const_iterator(); }
+
+	/** @param f called as f(value) for each element, from head to tail */
+	template<typename FUNCTION>
+	void for_each(FUNCTION f){
+		for(TemplateQueueNode * n = head; n; n = n->next)
+			f(n->data);
+	}
+
 	/** @return how many elements are in the queue */
 	inline const int & size() const{
 		return m_size;
@@ -0,0 +1,353 @@
+#pragma once
+
+#include "license.txt"
+
+#include <string.h>	// memcpy
+#include <utility>	// std::move
+#ifdef CPP11_HAS_TYPE_TRAITS
+#include <type_traits>
+#endif
+
+// SIMD instruction sets are picked at compile time, from the compiler's target
+// flags (-msse4.1, -mavx2, /arch:AVX2...). x86-64 always has SSE2.
+#if defined(__AVX2__)
+#define TEMPLATESCAN_AVX2
+#endif
+#if defined(__SSE4_1__) || defined(__AVX2__)
+#define TEMPLATESCAN_SSE4
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEMPLATESCAN_SSE2
+#endif
+
+#ifdef TEMPLATESCAN_AVX2
+#include <immintrin.h>
+#elif defined(TEMPLATESCAN_SSE4)
+#include <smmintrin.h>
+#elif defined(TEMPLATESCAN_SSE2)
+#include <emmintrin.h>
+#endif
+#if defined(_MSC_VER) && defined(TEMPLATESCAN_SSE2)
+#include <intrin.h>	// _BitScanForward
+#endif
+
+/**
+ * linear scans used by TemplateArray and TemplateVector: indexOf, removeAll
+ * and setAll. short, int, float, double and pointer (and other 2, 4 or 8 byte
+ * integer or enum) lists are scanned several elements per instruction with SSE2,
+ * SSE4.1 or AVX2, whichever the compiler is targeting. every other type, or
+ * a build without those instruction sets, uses plain loops with operator==.
+ * @author mvaganov@hotmail.com
+ */
+namespace TemplateScan
+{
+#ifdef CPP11_HAS_MOVE_SEMANTICS
+#define TEMPLATESCAN_MOVE(value)	std::move(value)
+#else
+#define TEMPLATESCAN_MOVE(value)	(value)
+#endif
+
+	/** which SIMD comparison can stand in for operator== */
+	enum LaneKind { LANES_NONE, LANES_INT16, LANES_INT32, LANES_INT64, LANES_FLOAT, LANES_DOUBLE };
+
+	/** @return LaneKind for DATA_TYPE. specialize to opt a type in or out */
+	template<typename DATA_TYPE>
+	struct ScanLanes
+	{
+#ifdef CPP11_HAS_TYPE_TRAITS
+		static const bool IS_INTEGER = std::is_integral<DATA_TYPE>::value
+			|| std::is_enum<DATA_TYPE>::value || std::is_pointer<DATA_TYPE>::value;
+		static const LaneKind value =
+			std::is_same<DATA_TYPE, float>::value ? LANES_FLOAT
+			: std::is_same<DATA_TYPE, double>::value ? LANES_DOUBLE
+			: (IS_INTEGER && sizeof(DATA_TYPE) == 2) ? LANES_INT16
+			: (IS_INTEGER && sizeof(DATA_TYPE) == 4) ? LANES_INT32
+			: (IS_INTEGER && sizeof(DATA_TYPE) == 8) ? LANES_INT64
+			: LANES_NONE;
+#else
+		static const LaneKind value = LANES_NONE;
+#endif
+	};
+
+	/** @return index of the lowest set bit. a_mask must not be 0 */
+	inline int lowestBit(unsigned int a_mask)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_ctz(a_mask);
+#elif defined(_MSC_VER) && defined(TEMPLATESCAN_SSE2)
+		unsigned long index;
+		_BitScanForward(&index, a_mask);
+		return (int)index;
+#else
+		int index = 0;
+		while(!(a_mask & 1))
+		{
+			a_mask >>= 1;
+			++index;
+		}
+		return index;
+#endif
+	}
+
+	/**
+	 * a block of elements compared in one instruction. each specialization has
+	 * BLOCK (elements per block), Needle (a_value in every lane),
+	 * needle(a_value), match(a_data, needle) (bit i set if a_data[i]==a_value),
+	 * fill(a_data, needle) and copy(a_dest, a_src) (safe if they overlap).
+	 * BLOCK is 0 when there is no SIMD for the kind.
+	 */
+	template<LaneKind KIND>
+	struct Block { static const int BLOCK = 0; };
+
+#if defined(TEMPLATESCAN_AVX2)
+	template<> struct Block<LANES_INT16>
+	{
+		static const int BLOCK = 16;
+		typedef __m256i Needle;
+		template<typename T> static Needle needle(T const & v) { short x; memcpy(&x, &v, sizeof(x)); return _mm256_set1_epi16(x); }
+		static unsigned int match(void const * p, Needle n) {
+			// packing the 16 bit results to bytes leaves elements 0-7 in bits 0-7 of the mask, and 8-15 in bits 16-23
+			unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_packs_epi16(
+				_mm256_cmpeq_epi16(_mm256_loadu_si256((__m256i const*)p), n), _mm256_setzero_si256()));
+			return (mask & 0xff) | ((mask >> 8) & 0xff00);
+		}
+		static void fill(void * p, Needle n) { _mm256_storeu_si256((__m256i*)p, n); }
+		static void copy(void * d, void const * s) { _mm256_storeu_si256((__m256i*)d, _mm256_loadu_si256((__m256i const*)s)); }
+	};
+	template<> struct Block<LANES_INT32>
+	{
+		static const int BLOCK = 8;
+		typedef __m256i Needle;
+		template<typename T> static Needle needle(T const & v) { int x; memcpy(&x, &v, sizeof(x)); return _mm256_set1_epi32(x); }
+		static unsigned int match(void const * p, Needle n) {
+			return (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_loadu_si256((__m256i const*)p), n)));
+		}
+		static void fill(void * p, Needle n) { _mm256_storeu_si256((__m256i*)p, n); }
+		static void copy(void * d, void const * s) { _mm256_storeu_si256((__m256i*)d, _mm256_loadu_si256((__m256i const*)s)); }
+	};
+	template<> struct Block<LANES_INT64>
+	{
+		static const int BLOCK = 4;
+		typedef __m256i Needle;
+		template<typename T> static Needle needle(T const & v) { long long x; memcpy(&x, &v, sizeof(x)); return _mm256_set1_epi64x(x); }
+		static unsigned int match(void const * p, Needle n) {
+			return (unsigned int)_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_loadu_si256((__m256i const*)p), n)));
+		}
+		static void fill(void * p, Needle n) { _mm256_storeu_si256((__m256i*)p, n); }
+		static void copy(void * d, void const * s) { _mm256_storeu_si256((__m256i*)d, _mm256_loadu_si256((__m256i const*)s)); }
+	};
+	template<> struct Block<LANES_FLOAT>
+	{
+		static const int BLOCK = 8;
+		typedef __m256 Needle;
+		static Needle needle(float const & v) { return _mm256_set1_ps(v); }
+		static unsigned int match(void const * p, Needle n) {
+			return (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps((float const*)p), n, _CMP_EQ_OQ));
+		}
+		static void fill(void * p, Needle n) { _mm256_storeu_ps((float*)p, n); }
+		static void copy(void * d, void const * s) { _mm256_storeu_ps((float*)d, _mm256_loadu_ps((float const*)s)); }
+	};
+	template<> struct Block<LANES_DOUBLE>
+	{
+		static const int BLOCK = 4;
+		typedef __m256d Needle;
+		static Needle needle(double const & v) { return _mm256_set1_pd(v); }
+		static unsigned int match(void const * p, Needle n) {
+			return (unsigned int)_mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd((double const*)p), n, _CMP_EQ_OQ));
+		}
+		static void fill(void * p, Needle n) { _mm256_storeu_pd((double*)p, n); }
+		static void copy(void * d, void const * s) { _mm256_storeu_pd((double*)d, _mm256_loadu_pd((double const*)s)); }
+	};
+#elif defined(TEMPLATESCAN_SSE2)
+	template<> struct Block<LANES_INT16>
+	{
+		static const int BLOCK = 8;
+		typedef __m128i Needle;
+		template<typename T> static Needle needle(T const & v) { short x; memcpy(&x, &v, sizeof(x)); return _mm_set1_epi16(x); }
+		static unsigned int match(void const * p, Needle n) {
+			// packed to bytes, for one mask bit per element
+			return (unsigned int)_mm_movemask_epi8(_mm_packs_epi16(
+				_mm_cmpeq_epi16(_mm_loadu_si128((__m128i const*)p), n), _mm_setzero_si128()));
+		}
+		static void fill(void * p, Needle n) { _mm_storeu_si128((__m128i*)p, n); }
+		static void copy(void * d, void const * s) { _mm_storeu_si128((__m128i*)d, _mm_loadu_si128((__m128i const*)s)); }
+	};
+	template<> struct Block<LANES_INT32>
+	{
+		static const int BLOCK = 4;
+		typedef __m128i Needle;
+		template<typename T> static Needle needle(T const & v) { int x; memcpy(&x, &v, sizeof(x)); return _mm_set1_epi32(x); }
+		static unsigned int match(void const * p, Needle n) {
+			return (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128((__m128i const*)p), n)));
+		}
+		static void fill(void * p, Needle n) { _mm_storeu_si128((__m128i*)p, n); }
+		static void copy(void * d, void const * s) { _mm_storeu_si128((__m128i*)d, _mm_loadu_si128((__m128i const*)s)); }
+	};
+	template<> struct Block<LANES_INT64>
+	{
+		static const int BLOCK = 2;
+		typedef __m128i Needle;
+		template<typename T> static Needle needle(T const & v) { long long x; memcpy(&x, &v, sizeof(x)); return _mm_set1_epi64x(x); }
+		static unsigned int match(void const * p, Needle n) {
+#ifdef TEMPLATESCAN_SSE4
+			return (unsigned int)_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(_mm_loadu_si128((__m128i const*)p), n)));
+#else
+			// SSE2 has no 64 bit compare: both 32 bit halves must be equal
+			const __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((__m128i const*)p), n);
+			return (unsigned int)_mm_movemask_pd(_mm_castsi128_pd(
+				_mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2,3,0,1)))));
+#endif
+		}
+		static void fill(void * p, Needle n) { _mm_storeu_si128((__m128i*)p, n); }
+		static void copy(void * d, void const * s) { _mm_storeu_si128((__m128i*)d, _mm_loadu_si128((__m128i const*)s)); }
+	};
+	template<> struct Block<LANES_FLOAT>
+	{
+		static const int BLOCK = 4;
+		typedef __m128 Needle;
+		static Needle needle(float const & v) { return _mm_set1_ps(v); }
+		static unsigned int match(void const * p, Needle n) {
+			return (unsigned int)_mm_movemask_ps(_mm_cmpeq_ps(_mm_loadu_ps((float const*)p), n));
+		}
+		static void fill(void * p, Needle n) { _mm_storeu_ps((float*)p, n); }
+		static void copy(void * d, void const * s) { _mm_storeu_ps((float*)d, _mm_loadu_ps((float const*)s)); }
+	};
+	template<> struct Block<LANES_DOUBLE>
+	{
+		static const int BLOCK = 2;
+		typedef __m128d Needle;
+		static Needle needle(double const & v) { return _mm_set1_pd(v); }
+		static unsigned int match(void const * p, Needle n) {
+			return (unsigned int)_mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd((double const*)p), n));
+		}
+		static void fill(void * p, Needle n) { _mm_storeu_pd((double*)p, n); }
+		static void copy(void * d, void const * s) { _mm_storeu_pd((double*)d, _mm_loadu_pd((double const*)s)); }
+	};
+#endif
+
+	/** the scans, with plain loops. the SIMD versions below finish with these */
+	template<typename DATA_TYPE, int BLOCK>
+	struct Scanner
+	{
+		static int indexOf(DATA_TYPE const * a_data, int a_first, const int a_limit, DATA_TYPE const & a_value)
+		{
+			for(int i = a_first; i < a_limit; ++i)
+			{
+				if(a_data[i] == a_value)
+					return i;
+			}
+			return -1;
+		}
+		static int removeAll(DATA_TYPE * a_data, const int a_count, DATA_TYPE const & a_value)
+		{
+			return compact(a_data, 0, 0, a_count, a_value);
+		}
+		/** moves elements of [a_read, a_count) that are not a_value down to a_write */
+		static int compact(DATA_TYPE * a_data, int a_write, int a_read, const int a_count, DATA_TYPE const & a_value)
+		{
+			for(; a_read < a_count; ++a_read)
+			{
+				if(!(a_data[a_read] == a_value))
+				{
+					if(a_write != a_read)
+						a_data[a_write] = TEMPLATESCAN_MOVE(a_data[a_read]);
+					++a_write;
+				}
+			}
+			return a_write;
+		}
+		static void setAll(DATA_TYPE * a_data, const int a_count, DATA_TYPE const & a_value)
+		{
+			for(int i = 0; i < a_count; ++i)
+			{
+				a_data[i] = a_value;
+			}
+		}
+	};
+
+	/** SIMD scans, for types whose Block<KIND>::BLOCK is not 0 */
+	template<typename DATA_TYPE, int BLOCK>
+	struct SimdScanner
+	{
+		typedef Block<ScanLanes<DATA_TYPE>::value> B;
+		typedef Scanner<DATA_TYPE, 0> Plain;
+
+		static int indexOf(DATA_TYPE const * a_data, int a_first, const int a_limit, DATA_TYPE const & a_value)
+		{
+			typename B::Needle needle = B::needle(a_value);
+			for(; a_first + BLOCK <= a_limit; a_first += BLOCK)
+			{
+				unsigned int mask = B::match(a_data+a_first, needle);
+				if(mask)
+					return a_first + lowestBit(mask);
+			}
+			return Plain::indexOf(a_data, a_first, a_limit, a_value);
+		}
+		static int removeAll(DATA_TYPE * a_data, const int a_count, DATA_TYPE const & a_value)
+		{
+			typename B::Needle needle = B::needle(a_value);
+			int write = 0, read = 0;
+			for(; read + BLOCK <= a_count; read += BLOCK)
+			{
+				unsigned int mask = B::match(a_data+read, needle);
+				if(!mask)
+				{
+					// nothing to remove in this block, slide all of it down
+					if(write != read)
+						B::copy(a_data+write, a_data+read);
+					write += BLOCK;
+				}
+				else
+				{
+					for(int i = 0; i < BLOCK; ++i)
+					{
+						if(!(mask & (1u << i)))
+							a_data[write++] = a_data[read+i];
+					}
+				}
+			}
+			return Plain::compact(a_data, write, read, a_count, a_value);
+		}
+		static void setAll(DATA_TYPE * a_data, const int a_count, DATA_TYPE const & a_value)
+		{
+			typename B::Needle needle = B::needle(a_value);
+			int i = 0;
+			for(; i + BLOCK <= a_count; i += BLOCK)
+			{
+				B::fill(a_data+i, needle);
+			}
+			Plain::setAll(a_data+i, a_count-i, a_value);
+		}
+	};
+
+	/** picks SimdScanner if DATA_TYPE has a SIMD Block, Scanner otherwise */
+	template<typename DATA_TYPE, int BLOCK = Block<ScanLanes<DATA_TYPE>::value>::BLOCK>
+	struct ScannerFor { typedef SimdScanner<DATA_TYPE, BLOCK> type; };
+	template<typename DATA_TYPE>
+	struct ScannerFor<DATA_TYPE, 0> { typedef Scanner<DATA_TYPE, 0> type; };
+
+	/** @return index of the first a_value in [a_first, a_limit), -1 if none. uses == */
+	template<typename DATA_TYPE>
+	inline int indexOf(DATA_TYPE const * a_data, const int a_first, const int a_limit, DATA_TYPE const & a_value)
+	{
+		return ScannerFor<DATA_TYPE>::type::indexOf(a_data, a_first, a_limit, a_value);
+	}
+
+	/**
+	 * moves every element not == a_value to the front, keeping their order
+	 * @return how many elements are kept. elements after those are moved-from
+	 */
+	template<typename DATA_TYPE>
+	inline int removeAll(DATA_TYPE * a_data, const int a_count, DATA_TYPE const & a_value)
+	{
+		return ScannerFor<DATA_TYPE>::type::removeAll(a_data, a_count, a_value);
+	}
+
+	/** assigns a_value to each of the a_count elements */
+	template<typename DATA_TYPE>
+	inline void setAll(DATA_TYPE * a_data, const int a_count, DATA_TYPE const & a_value)
+	{
+		ScannerFor<DATA_TYPE>::type::setAll(a_data, a_count, a_value);
+	}
+#undef TEMPLATESCAN_MOVE
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "license.txt"
+
+#include <stddef.h>	// size_t
+
+/**
+ * searching algorithms used by TemplateArray and TemplateVector. like
+ * TemplateSort, they work on a raw pointer and element count, and take a
+ * LESS callable that returns true if less(a, b) means a comes before b.
+ *
+ * the loops avoid data-dependent branches: the only branch is the loop
+ * condition, which depends only on the element count, so it is predicted
+ * well. the comparison result picks the next position with a conditional
+ * move instead of a jump that mispredicts about half the time.
+ * @author mvaganov@hotmail.com
+ */
+namespace TemplateSearch
+{
+#if defined(__GNUC__) || defined(__clang__)
+	/** hint that the memory at a_address will be read soon */
+	#define TEMPLATESEARCH_PREFETCH(a_address)	__builtin_prefetch((const void*)(a_address))
+#else
+	#define TEMPLATESEARCH_PREFETCH(a_address)
+#endif
+
+	/**
+	 * @return index of the first element in sorted a_data that is not less
+	 * than a_value (a_count if there is none)
+	 */
+	template<typename DATA_TYPE, typename LESS>
+	int lowerBound(DATA_TYPE const * a_data, const int a_count, DATA_TYPE const & a_value, LESS less)
+	{
+		if(a_count <= 0)
+			return 0;
+		DATA_TYPE const * base = a_data;
+		int n = a_count;
+		while(n > 1)
+		{
+			const int half = n / 2;
+			// both possible next midpoints, fetched before the compare resolves
+			TEMPLATESEARCH_PREFETCH(base + half/2);
+			TEMPLATESEARCH_PREFETCH(base + half + half/2);
+			base = less(base[half], a_value) ? base + half : base;
+			n -= half;
+		}
+		return (int)(base - a_data) + (less(*base, a_value) ? 1 : 0);
+	}
+
+	/**
+	 * @return index of the first element in sorted a_data that a_value is
+	 * less than (a_count if there is none): where a_value goes after its equals
+	 */
+	template<typename DATA_TYPE, typename LESS>
+	int upperBound(DATA_TYPE const * a_data, const int a_count, DATA_TYPE const & a_value, LESS less)
+	{
+		if(a_count <= 0)
+			return 0;
+		DATA_TYPE const * base = a_data;
+		int n = a_count;
+		while(n > 1)
+		{
+			const int half = n / 2;
+			TEMPLATESEARCH_PREFETCH(base + half/2);
+			TEMPLATESEARCH_PREFETCH(base + half + half/2);
+			base = less(a_value, base[half]) ? base : base + half;
+			n -= half;
+		}
+		return (int)(base - a_data) + (less(a_value, *base) ? 0 : 1);
+	}
+
+	/**
+	 * @param a_tree 1-indexed array (a_tree[0] unused) in Eytzinger order:
+	 * the children of a_tree[k] are a_tree[2k] and a_tree[2k+1]
+	 * @param a_count how many elements are in the tree (the last is a_tree[a_count])
+	 * @return tree index of the first element not less than a_value, 0 if none
+	 */
+	template<typename DATA_TYPE, typename LESS>
+	int eytzingerLowerBound(DATA_TYPE const * a_tree, const int a_count, DATA_TYPE const & a_value, LESS less)
+	{
+		// how many tree indexes fit in a cache line: prefetching a descendant
+		// that many levels down fetches a whole level of the search at once
+		const int linesAhead = (64 / sizeof(DATA_TYPE)) > 0 ? (int)(64 / sizeof(DATA_TYPE)) : 1;
+		unsigned int k = 1;
+		while(k <= (unsigned int)a_count)
+		{
+			TEMPLATESEARCH_PREFETCH(a_tree + ((size_t)k * linesAhead));
+			k = 2 * k + (less(a_tree[k], a_value) ? 1 : 0);
+		}
+		// the path went right (element too small) for every trailing 1 bit,
+		// the answer is where it last went left
+#if defined(__GNUC__) || defined(__clang__)
+		k >>= __builtin_ffs(~k);
+#else
+		while(k & 1)
+			k >>= 1;
+		k >>= 1;
+#endif
+		return (int)k;
+	}
+
+	/**
+	 * fills a 1-indexed Eytzinger tree from sorted a_sorted (in-order traversal)
+	 * @param a_tree where to write element k of the tree, using assignment
+	 * @param a_rank if not NULL, a_rank[k] gets the sorted index of a_tree[k]
+	 * @param a_next the next sorted index to place. start at 0
+	 * @param a_k tree index to fill. start at 1
+	 * @return the next sorted index to place
+	 */
+	template<typename DATA_TYPE>
+	int eytzingerFill(DATA_TYPE const * a_sorted, const int a_count, DATA_TYPE * a_tree,
+		int * a_rank, int a_next = 0, const int a_k = 1)
+	{
+		if(a_k <= a_count)
+		{
+			a_next = eytzingerFill(a_sorted, a_count, a_tree, a_rank, a_next, 2*a_k);
+			a_tree[a_k] = a_sorted[a_next];
+			if(a_rank)
+				a_rank[a_k] = a_next;
+			a_next = eytzingerFill(a_sorted, a_count, a_tree, a_rank, a_next+1, 2*a_k+1);
+		}
+		return a_next;
+	}
+#undef TEMPLATESEARCH_PREFETCH
+}
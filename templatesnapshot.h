@@ -0,0 +1,280 @@
+#pragma once
+
+#include "license.txt"
+#include "templatearray.h"
+
+#include <stdio.h>	// FILE, fopen, fwrite
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX	// keep windows.h from defining min and max
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>	// mmap
+#include <sys/stat.h>	// fstat
+#include <fcntl.h>		// open
+#include <unistd.h>		// close
+#endif
+
+/**
+ * the start of a snapshot file: a binary image of a container, that can be
+ * mapped into memory and used where it is, with no parsing and no copying.
+ * the header says where each array is, as a byte offset from the start of
+ * the file, so the file works wherever it is mapped. arrays start on
+ * cache line boundaries.
+ *
+ * the image is the machine's own memory layout, so it only loads on a
+ * machine with the same byte order and the same element layout. elements
+ * must be bitwise copyable, and hold no pointers.
+ */
+struct TemplateSnapshotHeader
+{
+	/** every snapshot file starts with these 8 characters */
+	static const char * MAGIC() { return "TSNAPSHT"; }
+	/** changes whenever the layout of snapshot files changes */
+	static const unsigned int VERSION = 1;
+	/** written as the machine that saved the file sees it */
+	static const unsigned int BYTE_ORDER_MARK = 0x01020304;
+	/** arrays in the file start at a multiple of this */
+	static const int ALIGNMENT = 64;
+	/** what a snapshot holds */
+	enum Kind { ARRAY = 1, HASHMAP = 2, HASHMAP_FROZEN = 3 };
+
+	char magic[8];
+	unsigned int byteOrder;
+	unsigned int version;
+	unsigned int kind;
+	/** sizeof one element */
+	unsigned int elementSize;
+	/** how many elements */
+	int count;
+	/** for a hash map: how many slots, and how full it may get before it grows */
+	int capacity;
+	float maxLoadFactor;
+	int reserved;
+	/** where the arrays are, and how many bytes each one is */
+	unsigned long long offset[2], size[2];
+	/** how big the whole file is */
+	unsigned long long fileSize;
+
+	/** starts a header for a snapshot of a_kind. the arrays are added with addArray */
+	void init(const Kind a_kind, const int a_elementSize, const int a_count)
+	{
+		memset(this, 0, sizeof(*this));
+		memcpy(magic, MAGIC(), sizeof(magic));
+		byteOrder = BYTE_ORDER_MARK;
+		version = VERSION;
+		kind = a_kind;
+		elementSize = (unsigned int)a_elementSize;
+		count = a_count;
+		fileSize = aligned(sizeof(*this));
+	}
+
+	/** @return a_offset rounded up to ALIGNMENT */
+	static unsigned long long aligned(const unsigned long long a_offset)
+	{
+		return (a_offset + ALIGNMENT-1) & ~(unsigned long long)(ALIGNMENT-1);
+	}
+
+	/** puts array a_index of a_bytes bytes at the end of the file */
+	void addArray(const int a_index, const unsigned long long a_bytes)
+	{
+		offset[a_index] = fileSize;
+		size[a_index] = a_bytes;
+		fileSize = aligned(fileSize + a_bytes);
+	}
+
+	/**
+	 * @param a_data a snapshot file in memory, a_size bytes long
+	 * @return the header, 0 if a_data is not a snapshot of a_kind with
+	 * elements of a_elementSize, saved by a compatible machine
+	 */
+	static TemplateSnapshotHeader const * check(const void * a_data, const unsigned long long a_size,
+		const Kind a_kind, const int a_elementSize)
+	{
+		TemplateSnapshotHeader const * header = (TemplateSnapshotHeader const *)a_data;
+		if(!a_data || a_size < sizeof(TemplateSnapshotHeader)
+		|| memcmp(header->magic, MAGIC(), sizeof(header->magic)) != 0
+		|| header->byteOrder != BYTE_ORDER_MARK || header->version != VERSION
+		|| header->kind != (unsigned int)a_kind || header->elementSize != (unsigned int)a_elementSize
+		|| header->fileSize > a_size || header->count < 0)
+			return 0;
+		for(int i = 0; i < 2; ++i)
+		{
+			// written so a huge offset or size can't wrap around
+			if(header->size[i] && (header->offset[i] % ALIGNMENT || header->size[i] > header->fileSize
+			|| header->offset[i] > header->fileSize - header->size[i]))
+				return 0;
+		}
+		return header;
+	}
+
+	/**
+	 * writes the header, then a_arrayCount arrays where addArray put them,
+	 * in one sequential pass
+	 * @return false if the file could not be written
+	 */
+	bool write(const char * a_filename, const void * const * a_arrays, const int a_arrayCount) const
+	{
+		FILE * file = fopen(a_filename, "wb");
+		if(!file)
+			return false;
+		static const char padding[ALIGNMENT] = {0};
+		bool ok = fwrite(this, sizeof(*this), 1, file) == 1;
+		unsigned long long written = sizeof(*this);
+		for(int i = 0; ok && i <= a_arrayCount; ++i)
+		{
+			const unsigned long long start = (i < a_arrayCount) ? offset[i] : fileSize;
+			if(written < start)
+				ok = fwrite(padding, (size_t)(start - written), 1, file) == 1;
+			written = start;
+			if(ok && i < a_arrayCount && size[i])
+			{
+				ok = fwrite(a_arrays[i], (size_t)size[i], 1, file) == 1;
+				written += size[i];
+			}
+		}
+		return (fclose(file) == 0) && ok;
+	}
+};
+
+/**
+ * a file mapped into memory, for using snapshots in place. pages are read
+ * from the file as they are first touched. the mapping is copy-on-write:
+ * writing to it makes a private copy of the page, and never changes the file.
+ */
+class TemplateMappedFile
+{
+	char * m_data;
+	unsigned long long m_size;
+#ifdef _WIN32
+	HANDLE m_file, m_mapping;
+#endif
+
+	/** not copyable */
+	TemplateMappedFile(TemplateMappedFile const &);
+	TemplateMappedFile & operator=(TemplateMappedFile const &);
+public:
+	TemplateMappedFile():m_data(0),m_size(0)
+#ifdef _WIN32
+		,m_file(INVALID_HANDLE_VALUE),m_mapping(0)
+#endif
+	{}
+	~TemplateMappedFile(){release();}
+
+	/** @return false if the file could not be mapped */
+	bool open(const char * a_filename)
+	{
+		release();
+#ifdef _WIN32
+		m_file = CreateFileA(a_filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+		LARGE_INTEGER size;
+		if(m_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_file, &size) || !size.QuadPart)
+		{
+			release();
+			return false;
+		}
+		m_mapping = CreateFileMappingA(m_file, 0, PAGE_WRITECOPY, 0, 0, 0);
+		m_data = m_mapping ? (char*)MapViewOfFile(m_mapping, FILE_MAP_COPY, 0, 0, 0) : 0;
+		if(!m_data)
+		{
+			release();
+			return false;
+		}
+		m_size = size.QuadPart;
+#else
+		const int file = ::open(a_filename, O_RDONLY);
+		if(file < 0)
+			return false;
+		struct stat status;
+		if(fstat(file, &status) != 0 || status.st_size <= 0)
+		{
+			::close(file);
+			return false;
+		}
+		void * data = mmap(0, (size_t)status.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+		::close(file);
+		if(data == MAP_FAILED)
+			return false;
+		m_data = (char*)data;
+		m_size = status.st_size;
+#endif
+		return true;
+	}
+
+	/** unmaps the file. anything using the mapping is invalid after this */
+	void release()
+	{
+#ifdef _WIN32
+		if(m_data)
+			UnmapViewOfFile(m_data);
+		if(m_mapping)
+			CloseHandle(m_mapping);
+		if(m_file != INVALID_HANDLE_VALUE)
+			CloseHandle(m_file);
+		m_mapping = 0;
+		m_file = INVALID_HANDLE_VALUE;
+#else
+		if(m_data)
+			munmap(m_data, (size_t)m_size);
+#endif
+		m_data = 0;
+		m_size = 0;
+	}
+
+	/** @return the start of the mapped file, 0 if no file is mapped */
+	inline char * data() const { return m_data; }
+	/** @return how many bytes are mapped */
+	inline unsigned long long size() const { return m_size; }
+};
+
+/**
+ * saves and loads TemplateArrays (and so TemplateVectors) as snapshot files.
+ * hash maps are saved and used by TemplateHashMapSnapshot, in templatehashmapsnapshot.h.
+ */
+namespace TemplateSnapshot
+{
+	/**
+	 * saves a_count elements at a_data as a snapshot file, in one sequential write
+	 * @return false if the file could not be written
+	 */
+	template<typename DATA_TYPE>
+	bool saveArray(const char * a_filename, DATA_TYPE const * a_data, const int a_count)
+	{
+#ifdef CPP11_HAS_TYPE_TRAITS
+		static_assert(TemplateArrayIsBitwiseCopyable<DATA_TYPE>::value, "snapshots hold bitwise copies of elements");
+#endif
+		TemplateSnapshotHeader header;
+		header.init(TemplateSnapshotHeader::ARRAY, sizeof(DATA_TYPE), a_count);
+		header.addArray(0, (unsigned long long)sizeof(DATA_TYPE) * a_count);
+		const void * arrays[1] = { a_data };
+		return header.write(a_filename, arrays, 1);
+	}
+
+	/** saves the elements of a_array as a snapshot file, in one sequential write */
+	template<typename DATA_TYPE>
+	bool saveArray(const char * a_filename, TemplateArray<DATA_TYPE> const & a_array)
+	{
+		return saveArray(a_filename, a_array.getRawListConst(), a_array.size());
+	}
+
+	/**
+	 * @param a_file a mapped array snapshot. must stay open while the elements are used
+	 * @param a_count how many elements the snapshot has
+	 * @return the elements, right where they are in the mapped file. 0 if
+	 * a_file is not an array snapshot of DATA_TYPE
+	 */
+	template<typename DATA_TYPE>
+	DATA_TYPE const * useArray(TemplateMappedFile const & a_file, int & a_count)
+	{
+		TemplateSnapshotHeader const * header = TemplateSnapshotHeader::check(a_file.data(), a_file.size(),
+			TemplateSnapshotHeader::ARRAY, sizeof(DATA_TYPE));
+		if(!header || header->size[0] != (unsigned long long)sizeof(DATA_TYPE) * header->count)
+		{
+			a_count = 0;
+			return 0;
+		}
+		a_count = header->count;
+		return (DATA_TYPE const *)(a_file.data() + header->offset[0]);
+	}
+}
@@ -0,0 +1,427 @@
+#pragma once
+
+#include "license.txt"
+#include "mem.h"
+
+#include <string.h>	// memcpy
+#include <utility>	// std::swap, std::move
+#include <new>		// placement new
+#ifdef CPP11_HAS_TYPE_TRAITS
+#include <type_traits>
+#endif
+
+/**
+ * sorting algorithms used by TemplateArray and TemplateVector. all of them
+ * work on a raw pointer and element count, and take a LESS callable, which
+ * is called as less(a, b) and returns true if a must come before b.
+ * comparators are template parameters, so they can be inlined.
+ *
+ * TemplateSort::sort picks the algorithm: LSD radix sort for integer and
+ * floating point types (when the list is big enough), introsort otherwise.
+ * @author mvaganov@hotmail.com
+ */
+namespace TemplateSort
+{
+	/** lists this size or smaller are insertion sorted */
+	static const int INSERTION_SORT_THRESHOLD = 16;
+
+	/** lists smaller than this are not worth radix sorting's extra buffer */
+	static const int RADIX_SORT_THRESHOLD = 256;
+
+	/** the default comparator, uses operator< */
+	template<typename DATA_TYPE>
+	struct Less
+	{
+		inline bool operator()(DATA_TYPE const & a, DATA_TYPE const & b) const
+		{
+			return a < b;
+		}
+	};
+
+#ifdef CPP11_HAS_MOVE_SEMANTICS
+#define TEMPLATESORT_MOVE(value)	std::move(value)
+#else
+#define TEMPLATESORT_MOVE(value)	(value)
+#endif
+
+	/** stable O(n^2) sort, fastest for very small lists */
+	template<typename DATA_TYPE, typename LESS>
+	void insertionSort(DATA_TYPE * a_data, const int a_count, LESS & less)
+	{
+		for(int i = 1; i < a_count; ++i)
+		{
+			if(!less(a_data[i], a_data[i-1]))
+				continue;
+			DATA_TYPE value(TEMPLATESORT_MOVE(a_data[i]));
+			int j = i;
+			do
+			{
+				a_data[j] = TEMPLATESORT_MOVE(a_data[j-1]);
+				--j;
+			}
+			while(j > 0 && less(value, a_data[j-1]));
+			a_data[j] = TEMPLATESORT_MOVE(value);
+		}
+	}
+
+	/** moves a_data[a_root] down the max-heap of a_count elements */
+	template<typename DATA_TYPE, typename LESS>
+	void siftDown(DATA_TYPE * a_data, int a_root, const int a_count, LESS & less)
+	{
+		int child;
+		while((child = a_root*2+1) < a_count)
+		{
+			if(child+1 < a_count && less(a_data[child], a_data[child+1]))
+				++child;
+			if(!less(a_data[a_root], a_data[child]))
+				return;
+			std::swap(a_data[a_root], a_data[child]);
+			a_root = child;
+		}
+	}
+
+	/** guaranteed O(n log n) sort, used when quicksort partitions badly */
+	template<typename DATA_TYPE, typename LESS>
+	void heapSort(DATA_TYPE * a_data, const int a_count, LESS & less)
+	{
+		for(int i = a_count/2-1; i >= 0; --i)
+		{
+			siftDown(a_data, i, a_count, less);
+		}
+		for(int last = a_count-1; last > 0; --last)
+		{
+			std::swap(a_data[0], a_data[last]);
+			siftDown(a_data, 0, last, less);
+		}
+	}
+
+	/** puts the median of a_data[a], a_data[b] and a_data[c] at a_data[b] */
+	template<typename DATA_TYPE, typename LESS>
+	inline void medianOfThree(DATA_TYPE * a_data, const int a, const int b, const int c, LESS & less)
+	{
+		if(less(a_data[b], a_data[a]))	std::swap(a_data[a], a_data[b]);
+		if(less(a_data[c], a_data[b]))
+		{
+			std::swap(a_data[b], a_data[c]);
+			if(less(a_data[b], a_data[a]))	std::swap(a_data[a], a_data[b]);
+		}
+	}
+
+	/** quicksort until a_depthLimit runs out, then heapSort. leaves small partitions unsorted */
+	template<typename DATA_TYPE, typename LESS>
+	void introsortLoop(DATA_TYPE * a_data, int a_count, int a_depthLimit, LESS & less)
+	{
+		while(a_count > INSERTION_SORT_THRESHOLD)
+		{
+			if(a_depthLimit-- == 0)
+			{
+				heapSort(a_data, a_count, less);
+				return;
+			}
+			// choose a pivot (ninther for big partitions), and put it at the front
+			const int mid = a_count/2, last = a_count-1;
+			if(a_count > 128)
+			{
+				const int step = a_count/8;
+				medianOfThree(a_data, 0, step, step*2, less);
+				medianOfThree(a_data, mid-step, mid, mid+step, less);
+				medianOfThree(a_data, last-step*2, last-step, last, less);
+				medianOfThree(a_data, step, mid, last-step, less);
+			}
+			else
+			{
+				medianOfThree(a_data, 0, mid, last, less);
+			}
+			std::swap(a_data[0], a_data[mid]);
+			// Hoare partition. stopping on equal elements keeps duplicates balanced
+			int i = 0, j = a_count;
+			while(true)
+			{
+				do{ ++i; }while(i < a_count && less(a_data[i], a_data[0]));
+				do{ --j; }while(less(a_data[0], a_data[j]));
+				if(i >= j)
+					break;
+				std::swap(a_data[i], a_data[j]);
+			}
+			std::swap(a_data[0], a_data[j]);
+			// recurse into the smaller side, loop on the bigger one
+			const int leftCount = j, rightCount = a_count-j-1;
+			if(leftCount < rightCount)
+			{
+				introsortLoop(a_data, leftCount, a_depthLimit, less);
+				a_data += j+1;
+				a_count = rightCount;
+			}
+			else
+			{
+				introsortLoop(a_data+j+1, rightCount, a_depthLimit, less);
+				a_count = leftCount;
+			}
+		}
+	}
+
+	/** unstable O(n log n) comparison sort: quicksort, falling back to heapsort */
+	template<typename DATA_TYPE, typename LESS>
+	void introsort(DATA_TYPE * a_data, const int a_count, LESS less)
+	{
+		if(a_count < 2)
+			return;
+		int depthLimit = 0;
+		for(int n = a_count; n > 1; n >>= 1)
+			depthLimit += 2;
+		introsortLoop(a_data, a_count, depthLimit, less);
+		insertionSort(a_data, a_count, less);
+	}
+
+	/**
+	 * stable merge sort
+	 * @param a_buffer raw memory for at least a_count/2 elements
+	 */
+	template<typename DATA_TYPE, typename LESS>
+	void mergeSort(DATA_TYPE * a_data, const int a_count, DATA_TYPE * a_buffer, LESS & less)
+	{
+		if(a_count <= INSERTION_SORT_THRESHOLD)
+		{
+			insertionSort(a_data, a_count, less);
+			return;
+		}
+		const int half = a_count/2;
+		mergeSort(a_data, half, a_buffer, less);
+		mergeSort(a_data+half, a_count-half, a_buffer, less);
+		// already in order, nothing to merge
+		if(!less(a_data[half], a_data[half-1]))
+			return;
+		// move the left half out of the way, then merge back into a_data
+		for(int i = 0; i < half; ++i)
+		{
+			new (a_buffer+i) DATA_TYPE(TEMPLATESORT_MOVE(a_data[i]));
+		}
+		int left = 0, right = half, out = 0;
+		while(left < half && right < a_count)
+		{
+			if(less(a_data[right], a_buffer[left]))
+				a_data[out++] = TEMPLATESORT_MOVE(a_data[right++]);
+			else
+				a_data[out++] = TEMPLATESORT_MOVE(a_buffer[left++]);
+		}
+		while(left < half)
+		{
+			a_data[out++] = TEMPLATESORT_MOVE(a_buffer[left++]);
+		}
+		for(int i = 0; i < half; ++i)
+		{
+			a_buffer[i].~DATA_TYPE();
+		}
+	}
+
+	/** stable O(n log n) comparison sort. needs a_count/2 elements of scratch memory */
+	template<typename DATA_TYPE, typename LESS>
+	void stableSort(DATA_TYPE * a_data, const int a_count, LESS less)
+	{
+		if(a_count < 2)
+			return;
+		char * buffer = NEWMEM_ARR(char, sizeof(DATA_TYPE)*(a_count/2+1));
+		if(!buffer)
+		{
+			// no scratch memory: still stable, just slow
+			insertionSort(a_data, a_count, less);
+			return;
+		}
+		mergeSort(a_data, a_count, (DATA_TYPE*)buffer, less);
+		DELMEM_ARR(buffer);
+	}
+
+#undef TEMPLATESORT_MOVE
+
+	/** unsigned integer type that is SIZE bytes big */
+	template<int SIZE> struct UnsignedOfSize;
+	template<> struct UnsignedOfSize<1>{ typedef unsigned char type; };
+	template<> struct UnsignedOfSize<2>{ typedef unsigned short type; };
+	template<> struct UnsignedOfSize<4>{ typedef unsigned int type; };
+	template<> struct UnsignedOfSize<8>{ typedef unsigned long long type; };
+
+	/**
+	 * turns a number into an unsigned key with the same ordering, so it can be
+	 * radix sorted one byte at a time.
+	 * -0.0 gets the same key as +0.0, since they compare equal, so a stable sort
+	 * keeps them in their original order. NaNs, which don't compare with
+	 * anything, are ordered by their bits: negative NaNs before -infinity,
+	 * positive NaNs after +infinity
+	 */
+	template<typename DATA_TYPE, bool IS_FLOAT, bool IS_SIGNED>
+	struct RadixKey
+	{
+		typedef typename UnsignedOfSize<sizeof(DATA_TYPE)>::type KEY;
+		static const KEY SIGN_BIT = ((KEY)1) << (sizeof(KEY)*8-1);
+		static inline KEY toKey(DATA_TYPE const & a_value)
+		{
+			KEY bits;
+			memcpy(&bits, &a_value, sizeof(KEY));
+			if(IS_FLOAT)
+			{
+				if(bits == SIGN_BIT)
+					bits = 0;
+				// negative floats sort backwards: flip all bits. positive: flip sign
+				return (bits & SIGN_BIT) ? (KEY)~bits : (KEY)(bits | SIGN_BIT);
+			}
+			// two's complement: flipping the sign bit puts negatives first
+			return IS_SIGNED ? (KEY)(bits ^ SIGN_BIT) : bits;
+		}
+	};
+
+	/**
+	 * stable LSD radix sort, one byte per pass. passes where every key has the
+	 * same byte are skipped.
+	 * @param a_buffer scratch memory for a_count elements
+	 */
+	template<typename DATA_TYPE, typename RADIX_KEY>
+	void radixSort(DATA_TYPE * a_data, const int a_count, DATA_TYPE * a_buffer)
+	{
+		typedef typename RADIX_KEY::KEY KEY;
+		const int DIGITS = sizeof(KEY);
+		if(a_count < 2)
+			return;
+		// count every digit of every key in one pass over the data
+		int counts[DIGITS][256];
+		memset(counts, 0, sizeof(counts));
+		for(int i = 0; i < a_count; ++i)
+		{
+			KEY key = RADIX_KEY::toKey(a_data[i]);
+			for(int d = 0; d < DIGITS; ++d)
+			{
+				counts[d][(key >> (d*8)) & 0xff]++;
+			}
+		}
+		DATA_TYPE * source = a_data, * dest = a_buffer;
+		const KEY firstKey = RADIX_KEY::toKey(a_data[0]);
+		for(int d = 0; d < DIGITS; ++d)
+		{
+			const int shift = d*8;
+			int * count = counts[d];
+			// all keys share this digit: this pass would not move anything
+			if(count[(firstKey >> shift) & 0xff] == a_count)
+				continue;
+			int offset = 0;
+			for(int b = 0; b < 256; ++b)
+			{
+				int c = count[b];
+				count[b] = offset;
+				offset += c;
+			}
+			for(int i = 0; i < a_count; ++i)
+			{
+				dest[count[(RADIX_KEY::toKey(source[i]) >> shift) & 0xff]++] = source[i];
+			}
+			DATA_TYPE * swap = source;
+			source = dest;
+			dest = swap;
+		}
+		if(source != a_data)
+		{
+			memcpy((void*)a_data, (const void*)source, sizeof(DATA_TYPE)*a_count);
+		}
+	}
+
+	/**
+	 * stable LSD radix sort, see radixSort(a_data, a_count, a_buffer)
+	 * @return false if the scratch buffer could not be allocated
+	 */
+	template<typename DATA_TYPE, typename RADIX_KEY>
+	bool radixSort(DATA_TYPE * a_data, const int a_count)
+	{
+		if(a_count < 2)
+			return true;
+		DATA_TYPE * buffer = NEWMEM_ARR(DATA_TYPE, a_count);
+		if(!buffer)
+			return false;
+		radixSort<DATA_TYPE, RADIX_KEY>(a_data, a_count, buffer);
+		DELMEM_ARR(buffer);
+		return true;
+	}
+
+	/** sorts with operator<. specialized below for radix-sortable numbers */
+	template<typename DATA_TYPE, bool IS_NUMBER>
+	struct DefaultSort
+	{
+		static inline void sort(DATA_TYPE * a_data, const int a_count)
+		{
+			introsort(a_data, a_count, Less<DATA_TYPE>());
+		}
+		static inline void sortStable(DATA_TYPE * a_data, const int a_count)
+		{
+			stableSort(a_data, a_count, Less<DATA_TYPE>());
+		}
+		/** introsort works in place, so the scratch memory is not needed */
+		static inline void sort(DATA_TYPE * a_data, const int a_count, DATA_TYPE *)
+		{
+			introsort(a_data, a_count, Less<DATA_TYPE>());
+		}
+		/** @param a_buffer raw scratch memory for a_count elements, so nothing is allocated */
+		static inline void sortStable(DATA_TYPE * a_data, const int a_count, DATA_TYPE * a_buffer)
+		{
+			Less<DATA_TYPE> less;
+			mergeSort(a_data, a_count, a_buffer, less);
+		}
+	};
+
+#ifdef CPP11_HAS_TYPE_TRAITS
+	/** integers and floating point numbers are radix sorted, which is also stable */
+	template<typename DATA_TYPE>
+	struct DefaultSort<DATA_TYPE, true>
+	{
+		typedef RadixKey<DATA_TYPE, std::is_floating_point<DATA_TYPE>::value,
+			std::is_signed<DATA_TYPE>::value> KEY;
+		static inline void sort(DATA_TYPE * a_data, const int a_count)
+		{
+			if(a_count < RADIX_SORT_THRESHOLD || !radixSort<DATA_TYPE, KEY>(a_data, a_count))
+				introsort(a_data, a_count, Less<DATA_TYPE>());
+		}
+		static inline void sortStable(DATA_TYPE * a_data, const int a_count)
+		{
+			if(a_count < RADIX_SORT_THRESHOLD || !radixSort<DATA_TYPE, KEY>(a_data, a_count))
+				stableSort(a_data, a_count, Less<DATA_TYPE>());
+		}
+		static inline void sort(DATA_TYPE * a_data, const int a_count, DATA_TYPE * a_buffer)
+		{
+			if(a_count < RADIX_SORT_THRESHOLD)
+				introsort(a_data, a_count, Less<DATA_TYPE>());
+			else
+				radixSort<DATA_TYPE, KEY>(a_data, a_count, a_buffer);
+		}
+		static inline void sortStable(DATA_TYPE * a_data, const int a_count, DATA_TYPE * a_buffer)
+		{
+			radixSort<DATA_TYPE, KEY>(a_data, a_count, a_buffer);
+		}
+	};
+
+	/** true for the types DefaultSort will radix sort */
+	template<typename DATA_TYPE>
+	struct IsRadixSortable
+	{
+		static const bool value = (std::is_integral<DATA_TYPE>::value
+			&& !std::is_same<DATA_TYPE, bool>::value && sizeof(DATA_TYPE) <= 8)
+			|| (std::is_floating_point<DATA_TYPE>::value
+			&& (sizeof(DATA_TYPE) == 4 || sizeof(DATA_TYPE) == 8));
+	};
+#else
+	template<typename DATA_TYPE>
+	struct IsRadixSortable
+	{
+		static const bool value = false;
+	};
+#endif
+
+	/** sorts with operator<, picking the fastest algorithm for DATA_TYPE */
+	template<typename DATA_TYPE>
+	inline void sort(DATA_TYPE * a_data, const int a_count)
+	{
+		DefaultSort<DATA_TYPE, IsRadixSortable<DATA_TYPE>::value>::sort(a_data, a_count);
+	}
+
+	/** sorts with operator<, keeping equal elements in their original order */
+	template<typename DATA_TYPE>
+	inline void sortStable(DATA_TYPE * a_data, const int a_count)
+	{
+		DefaultSort<DATA_TYPE, IsRadixSortable<DATA_TYPE>::value>::sortStable(a_data, a_count);
+	}
+}
@@ -0,0 +1,315 @@
+#pragma once
+
+#include "license.txt"
+#include "templatesort.h"
+
+#include <thread>
+
+/**
+ * multi-threaded merge sort for big lists. the list is cut into one chunk
+ * per thread, chunks are sorted concurrently, then merged in rounds. each
+ * merge is split between threads too, so the last rounds (few, big merges)
+ * still keep every thread busy.
+ *
+ * all scratch memory is allocated by the calling thread before any worker
+ * starts, so the workers never call into the memory manager.
+ * @note starting and joining threads allocates, so USE_CUSTOM_MEMORY_MANAGEMENT
+ * needs USE_CUSTOM_MEMORY_MANAGEMENT_THREADS to be used with this code.
+ */
+namespace TemplateSort
+{
+	/** lists smaller than this are sorted on the calling thread */
+	static const int PARALLEL_SORT_THRESHOLD = 1 << 16;
+
+	/** @return how many threads to sort a_count elements with, given a requested a_threadCount (<1 means one per core) */
+	inline int parallelThreadCount(int a_threadCount, const int a_count)
+	{
+		if(a_threadCount < 1)
+		{
+			a_threadCount = (int)std::thread::hardware_concurrency();
+			if(a_threadCount < 1)
+				a_threadCount = 1;
+		}
+		// every thread should get a chunk worth the overhead of a thread
+		const int mostThreads = a_count / (PARALLEL_SORT_THRESHOLD/4);
+		if(a_threadCount > mostThreads)
+			a_threadCount = mostThreads;
+		return a_threadCount < 1 ? 1 : a_threadCount;
+	}
+
+	/**
+	 * @return how many elements of a_a come before output index a_k when
+	 * a_a and a_b are merged (ties take from a_a first, to stay stable)
+	 */
+	template<typename DATA_TYPE, typename LESS>
+	int mergeCoRank(const int a_k, DATA_TYPE * a_a, const int a_aCount,
+		DATA_TYPE * a_b, const int a_bCount, LESS & less)
+	{
+		int low = a_k > a_bCount ? a_k-a_bCount : 0;
+		int high = a_k < a_aCount ? a_k : a_aCount;
+		while(low < high)
+		{
+			const int i = (low + high) / 2, j = a_k - i;
+			// a_a[i] belongs before a_b[j-1], so more of a_a is needed
+			if(j > 0 && i < a_aCount && !less(a_b[j-1], a_a[i]))
+				low = i + 1;
+			else
+				high = i;
+		}
+		return low;
+	}
+
+	/**
+	 * merges sorted a_a and a_b into a_out. if CONSTRUCT, a_out is raw memory
+	 * that gets move-constructed, otherwise it is move-assigned
+	 */
+	template<bool CONSTRUCT, typename DATA_TYPE, typename LESS>
+	void mergeInto(DATA_TYPE * a_a, const int a_aCount, DATA_TYPE * a_b, const int a_bCount,
+		DATA_TYPE * a_out, LESS & less)
+	{
+		int i = 0, j = 0;
+		while(i < a_aCount || j < a_bCount)
+		{
+			DATA_TYPE & next = (j >= a_bCount || (i < a_aCount && !less(a_b[j], a_a[i])))
+				? a_a[i++] : a_b[j++];
+			if(CONSTRUCT)
+				new (a_out) DATA_TYPE(std::move(next));
+			else
+				*a_out = std::move(next);
+			++a_out;
+		}
+	}
+
+	/** a piece of one merge round, done by one thread */
+	template<typename DATA_TYPE>
+	struct ParallelMergeTask
+	{
+		DATA_TYPE * a, * b, * out;
+		int aCount, bCount;
+	};
+
+	/** calls a_work(t) for t in [0,a_taskCount), spread over a_threadCount threads */
+	template<typename WORK>
+	void runOnThreads(std::thread * a_threads, const int a_threadCount, const int a_taskCount, WORK & a_work)
+	{
+		int threadsUsed = a_threadCount < a_taskCount ? a_threadCount : a_taskCount;
+		for(int t = 1; t < threadsUsed; ++t)
+		{
+			a_threads[t] = std::thread([&a_work, t, threadsUsed, a_taskCount]() {
+				for(int task = t; task < a_taskCount; task += threadsUsed)
+					a_work(task);
+			});
+		}
+		// the calling thread does a share of the work too
+		for(int task = 0; task < a_taskCount; task += threadsUsed)
+			a_work(task);
+		for(int t = 1; t < threadsUsed; ++t)
+			a_threads[t].join();
+	}
+
+	/**
+	 * sorts using a_threadCount threads. stable if CHUNK_SORT is stable.
+	 * @param chunkSort called as chunkSort(data, count, rawBuffer), where
+	 * rawBuffer is scratch memory for count elements. chunkSort(data, count)
+	 * sorts serially, when threads are not worth it.
+	 */
+	template<typename DATA_TYPE, typename LESS, typename CHUNK_SORT>
+	void parallelMergeSort(DATA_TYPE * a_data, const int a_count, LESS less,
+		CHUNK_SORT chunkSort, const int a_threadCount)
+	{
+		const int threadCount = parallelThreadCount(a_threadCount, a_count);
+		if(threadCount < 2 || a_count < PARALLEL_SORT_THRESHOLD)
+		{
+			// too small to be worth the threads
+			chunkSort(a_data, a_count);
+			return;
+		}
+		char * raw = NEWMEM_ARR(char, sizeof(DATA_TYPE)*a_count);
+		int * runs = NEWMEM_ARR(int, threadCount+1);
+		ParallelMergeTask<DATA_TYPE> * tasks = NEWMEM_ARR(ParallelMergeTask<DATA_TYPE>, threadCount*2+1);
+		std::thread * threads = NEWMEM_ARR(std::thread, threadCount);
+		if(!raw || !runs || !tasks || !threads)
+		{
+			DELMEM_CLEAN_ARR(raw);
+			DELMEM_CLEAN_ARR(runs);
+			DELMEM_CLEAN_ARR(tasks);
+			DELMEM_CLEAN_ARR(threads);
+			chunkSort(a_data, a_count);
+			return;
+		}
+		DATA_TYPE * buffer = (DATA_TYPE*)raw;
+		// sort one chunk per thread. each chunk uses its own part of the buffer
+		int runCount = threadCount;
+		for(int r = 0; r <= runCount; ++r)
+		{
+			runs[r] = (int)(((long long)a_count * r) / runCount);
+		}
+		auto sortChunk = [&](const int a_chunk) {
+			const int start = runs[a_chunk];
+			chunkSort(a_data+start, runs[a_chunk+1]-start, buffer+start);
+		};
+		runOnThreads(threads, threadCount, runCount, sortChunk);
+		// merge neighboring runs, back and forth between a_data and the buffer
+		DATA_TYPE * source = a_data, * dest = buffer;
+		bool bufferConstructed = false;
+		while(runCount > 1)
+		{
+			const int pairs = runCount / 2;
+			int piecesPerPair = threadCount / pairs;
+			if(piecesPerPair < 1)	piecesPerPair = 1;
+			int taskCount = 0;
+			for(int p = 0; p < pairs; ++p)
+			{
+				const int start = runs[p*2], mid = runs[p*2+1], end = runs[p*2+2];
+				DATA_TYPE * a = source+start, * b = source+mid;
+				const int aCount = mid-start, bCount = end-mid, total = end-start;
+				int lastK = 0, lastI = 0;
+				for(int piece = 1; piece <= piecesPerPair; ++piece)
+				{
+					const int k = (int)(((long long)total * piece) / piecesPerPair);
+					const int i = mergeCoRank(k, a, aCount, b, bCount, less);
+					ParallelMergeTask<DATA_TYPE> & task = tasks[taskCount++];
+					task.a = a+lastI;			task.aCount = i-lastI;
+					task.b = b+(lastK-lastI);	task.bCount = (k-i)-(lastK-lastI);
+					task.out = dest+start+lastK;
+					lastK = k;
+					lastI = i;
+				}
+			}
+			// an odd run out just moves across
+			if(runCount & 1)
+			{
+				const int start = runs[runCount-1];
+				ParallelMergeTask<DATA_TYPE> & task = tasks[taskCount++];
+				task.a = source+start;	task.aCount = runs[runCount]-start;
+				task.b = 0;				task.bCount = 0;
+				task.out = dest+start;
+			}
+			const bool construct = (dest == buffer && !bufferConstructed);
+			auto merge = [&](const int a_task) {
+				ParallelMergeTask<DATA_TYPE> & t = tasks[a_task];
+				if(construct)
+					mergeInto<true>(t.a, t.aCount, t.b, t.bCount, t.out, less);
+				else
+					mergeInto<false>(t.a, t.aCount, t.b, t.bCount, t.out, less);
+			};
+			runOnThreads(threads, threadCount, taskCount, merge);
+			if(dest == buffer)
+				bufferConstructed = true;
+			// the merged runs are now twice as long
+			for(int r = 0; r <= pairs; ++r)
+			{
+				runs[r] = runs[r*2];
+			}
+			if(runCount & 1)
+				runs[pairs+1] = a_count;
+			runCount = pairs + (runCount & 1);
+			DATA_TYPE * swap = source;
+			source = dest;
+			dest = swap;
+		}
+		if(source != a_data)
+		{
+			for(int i = 0; i < a_count; ++i)
+				a_data[i] = std::move(buffer[i]);
+		}
+		if(bufferConstructed)
+		{
+			for(int i = 0; i < a_count; ++i)
+				buffer[i].~DATA_TYPE();
+		}
+		DELMEM_ARR(raw);
+		DELMEM_ARR(runs);
+		DELMEM_ARR(tasks);
+		DELMEM_ARR(threads);
+	}
+
+	/** chunk sort for parallelSort: picks the fastest algorithm, like sort() */
+	template<typename DATA_TYPE>
+	struct DefaultChunkSort
+	{
+		inline void operator()(DATA_TYPE * a_data, const int a_count) const
+		{
+			sort(a_data, a_count);
+		}
+		inline void operator()(DATA_TYPE * a_data, const int a_count, DATA_TYPE * a_buffer) const
+		{
+			DefaultSort<DATA_TYPE, IsRadixSortable<DATA_TYPE>::value>::sort(a_data, a_count, a_buffer);
+		}
+	};
+
+	/** chunk sort for parallelSortStable */
+	template<typename DATA_TYPE>
+	struct DefaultStableChunkSort
+	{
+		inline void operator()(DATA_TYPE * a_data, const int a_count) const
+		{
+			sortStable(a_data, a_count);
+		}
+		inline void operator()(DATA_TYPE * a_data, const int a_count, DATA_TYPE * a_buffer) const
+		{
+			DefaultSort<DATA_TYPE, IsRadixSortable<DATA_TYPE>::value>::sortStable(a_data, a_count, a_buffer);
+		}
+	};
+
+	/** chunk sort for parallelSort with a comparator */
+	template<typename DATA_TYPE, typename LESS>
+	struct ComparatorChunkSort
+	{
+		LESS less;
+		ComparatorChunkSort(LESS a_less):less(a_less){}
+		inline void operator()(DATA_TYPE * a_data, const int a_count)
+		{
+			introsort(a_data, a_count, less);
+		}
+		/** introsort works in place, so the scratch memory is not needed */
+		inline void operator()(DATA_TYPE * a_data, const int a_count, DATA_TYPE *)
+		{
+			introsort(a_data, a_count, less);
+		}
+	};
+
+	/** chunk sort for parallelSortStable with a comparator */
+	template<typename DATA_TYPE, typename LESS>
+	struct ComparatorStableChunkSort
+	{
+		LESS less;
+		ComparatorStableChunkSort(LESS a_less):less(a_less){}
+		inline void operator()(DATA_TYPE * a_data, const int a_count)
+		{
+			stableSort(a_data, a_count, less);
+		}
+		inline void operator()(DATA_TYPE * a_data, const int a_count, DATA_TYPE * a_buffer)
+		{
+			mergeSort(a_data, a_count, a_buffer, less);
+		}
+	};
+
+	/** sorts with operator< using a_threadCount threads (<1 means one per core) */
+	template<typename DATA_TYPE>
+	inline void parallelSort(DATA_TYPE * a_data, const int a_count, const int a_threadCount)
+	{
+		parallelMergeSort(a_data, a_count, Less<DATA_TYPE>(), DefaultChunkSort<DATA_TYPE>(), a_threadCount);
+	}
+
+	/** stable sort with operator< using a_threadCount threads (<1 means one per core) */
+	template<typename DATA_TYPE>
+	inline void parallelSortStable(DATA_TYPE * a_data, const int a_count, const int a_threadCount)
+	{
+		parallelMergeSort(a_data, a_count, Less<DATA_TYPE>(), DefaultStableChunkSort<DATA_TYPE>(), a_threadCount);
+	}
+
+	/** sorts with aBeforeB using a_threadCount threads (<1 means one per core) */
+	template<typename DATA_TYPE, typename LESS>
+	inline void parallelSort(DATA_TYPE * a_data, const int a_count, LESS aBeforeB, const int a_threadCount)
+	{
+		parallelMergeSort(a_data, a_count, aBeforeB, ComparatorChunkSort<DATA_TYPE, LESS>(aBeforeB), a_threadCount);
+	}
+
+	/** stable sort with aBeforeB using a_threadCount threads (<1 means one per core) */
+	template<typename DATA_TYPE, typename LESS>
+	inline void parallelSortStable(DATA_TYPE * a_data, const int a_count, LESS aBeforeB, const int a_threadCount)
+	{
+		parallelMergeSort(a_data, a_count, aBeforeB, ComparatorStableChunkSort<DATA_TYPE, LESS>(aBeforeB), a_threadCount);
+	}
+}
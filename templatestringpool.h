@@ -0,0 +1,202 @@
+#pragma once
+
+#include "license.txt"
+#include "templatehashmap.h"
+
+#include <assert.h>
+
+/**
+ * the header in front of every string a TemplateStringPool interns. the
+ * string's characters follow it, null-terminated
+ */
+struct TemplateInternedHeader
+{
+	/** TemplateHash::hashBytes of the characters */
+	unsigned long long hash;
+	/** how many characters, not counting the terminator */
+	int length;
+	/** checkFor(hash, length), to catch strings that are not from a pool. fills what would be padding */
+	int check;
+
+	static inline int checkFor(const unsigned long long a_hash, const int a_length)
+	{
+		return (int)(a_hash >> 32) ^ a_length ^ 0x7e11ed5;
+	}
+
+	/**
+	 * @return the header in front of a string from a TemplateStringPool.
+	 * asserts a_interned is one: pooled strings are 8-byte aligned, and their
+	 * header's check matches
+	 */
+	static inline TemplateInternedHeader const * of(const char * a_interned)
+	{
+		TemplateInternedHeader const * header = (TemplateInternedHeader const *)a_interned - 1;
+		assert(!((size_t)a_interned & 7) && header->check == checkFor(header->hash, header->length)
+			&& "string is not from a TemplateStringPool");
+		return header;
+	}
+};
+
+/**
+ * the hash functor for strings interned by a TemplateStringPool: reads the
+ * hash stored in front of the string instead of hashing the characters.
+ * (pointer, length) slices hash the same way TemplateStringHasher does.
+ * @note every null-terminated key must come from a TemplateStringPool.
+ * unless NDEBUG is defined, one that doesn't fails an assert
+ */
+struct TemplateInternedHasher
+{
+	inline size_t operator()(const char * const & a_key) const
+	{
+		return (size_t)TemplateInternedHeader::of(a_key)->hash;
+	}
+	inline size_t operator()(const char * a_key, const int a_length) const
+	{
+		return (size_t)TemplateHash::hashBytes(a_key, (size_t)a_length);
+	}
+};
+
+/**
+ * a hash map keyed by strings interned in a TemplateStringPool. since each
+ * distinct string is interned once, keys are compared by pointer, and the
+ * hash is read rather than computed.
+ */
+template <class VALUE>
+class TemplateHashMapInterned : public TemplateHashMap<const char*, VALUE, TemplateInternedHasher>
+{
+};
+
+/**
+ * interns strings: keeps one copy of each distinct string, so equal strings
+ * are the same pointer. copies are packed into large chunks of memory, each
+ * with its length and hash in front (see TemplateInternedHeader), and never
+ * move until the pool is released, so the pointers are stable handles.
+ *
+ * interned strings are null-terminated, and work as keys of any map that
+ * takes const char*. TemplateHashMapInterned compares them by pointer.
+ */
+class TemplateStringPool
+{
+	/** the memory strings are copied into */
+	TemplateVector<char*> m_chunks;
+	/** how many bytes of the last chunk are used */
+	int m_used;
+	/** how big the last chunk is */
+	int m_chunkCapacity;
+	/** how big a new chunk is, unless a string needs more */
+	int m_chunkSize;
+	/** every interned string, to find the copy of a string that is already in the pool */
+	TemplateHashMapNamed<int, TemplateInternedHasher> m_strings;
+
+	/** not copyable */
+	TemplateStringPool(TemplateStringPool const &);
+	TemplateStringPool & operator=(TemplateStringPool const &);
+
+	/** @return a_size bytes of chunk memory, 8-byte aligned. 0 if there is no memory */
+	char * allocate(const int a_size)
+	{
+		const int aligned = (a_size + 7) & ~7;
+		if(!m_chunks.size() || m_used + aligned > m_chunkCapacity)
+		{
+			const int capacity = (aligned > m_chunkSize) ? aligned : m_chunkSize;
+			unsigned long long * chunk = NEWMEM_ARR(unsigned long long, capacity/8);
+			if(!chunk)
+				return 0;
+			const int chunks = m_chunks.size();
+			NEWMEM_SOURCE_TRACE(m_chunks.add((char*)chunk));
+			if(m_chunks.size() == chunks)
+			{
+				DELMEM_ARR(chunk);
+				return 0;
+			}
+			m_chunkCapacity = capacity;
+			m_used = 0;
+		}
+		char * memory = m_chunks.getLast() + m_used;
+		m_used += aligned;
+		return memory;
+	}
+public:
+	/** @param a_chunkSize how many bytes of string memory to allocate at a time */
+	TemplateStringPool(const int a_chunkSize = 4096)
+		:m_used(0),m_chunkCapacity(0),m_chunkSize((a_chunkSize + 7) & ~7){}
+	~TemplateStringPool(){release();}
+
+	/** @return the length of a string from a TemplateStringPool, without a strlen */
+	static inline int lengthOf(const char * a_interned)
+	{
+		return TemplateInternedHeader::of(a_interned)->length;
+	}
+	/** @return the hash of a string from a TemplateStringPool (TemplateHash::hashBytes), without hashing */
+	static inline unsigned long long hashOf(const char * a_interned)
+	{
+		return TemplateInternedHeader::of(a_interned)->hash;
+	}
+
+	/**
+	 * @return the pooled copy of the a_length characters at a_string (which
+	 * need no terminator), 0 if that string was never interned
+	 */
+	const char * find(const char * a_string, const int a_length) const
+	{
+		NameValuePair<int> const * found = m_strings.getPairByKey(a_string, a_length);
+		return found ? found->k : 0;
+	}
+	/** @return the pooled copy of a null-terminated string, 0 if it was never interned */
+	const char * find(const char * a_string) const
+	{
+		return find(a_string, (int)strlen(a_string));
+	}
+
+	/**
+	 * @return the pooled copy of the a_length characters at a_string (which
+	 * need no terminator), copying it into the pool if it is not there yet.
+	 * 0 if there is no memory to copy it into
+	 */
+	const char * intern(const char * a_string, const int a_length)
+	{
+		const char * found = find(a_string, a_length);
+		if(found)
+			return found;
+		TemplateInternedHeader * header;
+		NEWMEM_SOURCE_TRACE(header = (TemplateInternedHeader*)allocate(sizeof(TemplateInternedHeader)+a_length+1));
+		if(!header)
+			return 0;
+		header->hash = TemplateHash::hashBytes(a_string, (size_t)a_length);
+		header->length = a_length;
+		header->check = TemplateInternedHeader::checkFor(header->hash, a_length);
+		char * copy = (char*)(header+1);
+		memcpy(copy, a_string, a_length);
+		copy[a_length] = '\0';
+		bool added = false;
+		NEWMEM_SOURCE_TRACE(added = m_strings.set(copy, m_strings.size()));
+		return added ? copy : 0;
+	}
+	/** @return the pooled copy of a null-terminated string, copying it into the pool if it is not there yet. 0 if there is no memory */
+	const char * intern(const char * a_string)
+	{
+		return intern(a_string, (int)strlen(a_string));
+	}
+	/** @return the pooled copy of the given string, copying it into the pool if it is not there yet */
+	template<typename CHAR>
+	const char * intern(TemplatedString<CHAR> const & a_string)
+	{
+		return intern(a_string.begin(), a_string.length());
+	}
+
+	/** @return how many distinct strings are in the pool */
+	inline int size() const { return m_strings.size(); }
+
+	/** forgets every string and frees the pool's memory. every pointer the pool gave out is invalid after this */
+	void release()
+	{
+		m_strings.release();
+		for(int i = 0; i < m_chunks.size(); ++i)
+		{
+			unsigned long long * chunk = (unsigned long long *)m_chunks[i];
+			DELMEM_ARR(chunk);
+		}
+		m_chunks.release();
+		m_used = m_chunkCapacity = 0;
+	}
+};
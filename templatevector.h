@@ -6,6 +6,8 @@
 /**
  * Simple templated vector. Ideal for dynamic lists of primitive types and 
  * single dimensional pointers. Fast access.
+ * Memory is allocated ahead of need, but only the elements in [0,size()) are
+ * constructed: unused capacity is raw memory.
  * @WARNING template with virtual types, or types that will be referenced by
  * other pointers to at your own risk! In those situations, templated lists of
  * pointers to those types are a much better idea. Or, TemplatedVectorList, 
@@ -15,57 +17,41 @@
 template<typename DATA_TYPE>
 class TemplateVector : public TemplateArray<DATA_TYPE>
 {
-protected:
-	/** the default size to allocate new vectors to */
-	static const int DEFAULT_ALLOCATION_SIZE = 8;
-
-	/** number of valid elements that the caller thinks we have.. */
-	int m_size;
 public:
-	/** @return true if the given index is safe to access in this array */
-	inline bool isValidIndex(int const a_index) const
-	{
-		return a_index >= 0 && a_index < m_size;
-	}
-
-	/** @return the size of the list */
-	inline const int & size() const
-	{
-		return m_size;
-	}
-
 	/** @return how many elements are allocated to the vector in memory */
 	inline const int & getAllocatedSize() const
 	{
-		return TemplateArray<DATA_TYPE>::size();
+		return this->m_capacity;
 	}
 
 	/** sets all fields to an initial data state. WARNING: can cause memory leaks if used without care */
 	inline void init()
 	{
 		TemplateArray<DATA_TYPE>::init();
-		m_size = 0;
 	}
 
 	/** cleans up memory */
 	inline void release()
 	{
 		TemplateArray<DATA_TYPE>::release();
-		m_size = 0;
+	}
+
+	/** @return true if vector has memory for a_size elements (does not change size) */
+	inline bool ensureCapacity(const int a_size)
+	{
+		return TemplateArray<DATA_TYPE>::reserve(a_size);
 	}
 
 	/** @return true of the copy finished correctly */
 	inline bool copy(TemplateVector<DATA_TYPE> const & a_vector)
 	{
+		clear();
 		bool allocated = false;
-		NEWMEM_SOURCE_TRACE(allocated = TemplateArray<DATA_TYPE>::ensureCapacity(a_vector.m_size));
+		NEWMEM_SOURCE_TRACE(allocated = ensureCapacity(a_vector.size()));
 		if(allocated)
 		{
-			for(int i = 0; i < a_vector.m_size; ++i)
-			{
-				TemplateArray<DATA_TYPE>::set(i, a_vector.getCONSTREF(i));
-			}
-			m_size = a_vector.m_size;
+			TemplateArray<DATA_TYPE>::copyElements(this->m_data, a_vector.m_data, a_vector.size());
+			this->m_allocated = a_vector.size();
 			return true;
 		}
 		return false;
@@ -83,8 +69,6 @@ public:
 	void abduct(TemplateVector<DATA_TYPE> & a_vector)
 	{
 		TemplateArray<DATA_TYPE>::abduct(a_vector);
-		m_size = a_array.m_size;
-		a_array.m_size = 0;
 	}
 
 #ifdef CPP11_HAS_MOVE_SEMANTICS
@@ -92,11 +76,9 @@ public:
 	inline void moveSemantic(TemplateVector & a_vector)
 	{
 		TemplateArray<DATA_TYPE>::moveSemantic(a_vector);
-		m_size = a_vector.m_size;
-		a_vector.m_size = 0;
 	}
 
-	/**
+	/** 
 	 * move constructor, for C++11, to make the following efficient
 	 * <code>TemplateVector<int> list(TemplateVector<int>());</code>
 	 */
@@ -105,7 +87,7 @@ public:
 		moveSemantic(a_vector);
 	}
 
-	/**
+	/** 
 	 * move assignment, for C++11, to make the following efficient
 	 * <code>TemplateVector<int> list = TemplateVector<int>();</code>
 	 */
@@ -116,28 +98,14 @@ public:
 	}
 #endif
 
-#ifdef CPP11_HAS_LAMBDA_SEMANTICS
-	/** @param f execute this code for each element of this container */
-	void for_each_full(std::function<void (DATA_TYPE & value, const int index)> f){
-		for(int i = 0; i < size(); ++i)
-			f(TemplateArray<DATA_TYPE>::get(i), i);
-	}
-	/** @param f execute this code for each element of this container */
-	void for_each(std::function<void (DATA_TYPE & value)> f){
-		for(int i = 0; i < size(); ++i)
-			f(TemplateArray<DATA_TYPE>::get(i));
-	}
-#endif
-
 #ifdef CPP11_HAS_INITIALIZER_LIST
     TemplateVector( const std::initializer_list <DATA_TYPE> & ilist )
     {
     	init();
-    	TemplateArray<DATA_TYPE>::setSize(ilist.size());
+    	ensureCapacity((int)ilist.size());
         auto it = ilist.begin();
-        int index = 0;
         while( it != ilist.end() ) {
-        	set(index++, *it);
+        	add(*it);
             it++;
         }
     }
@@ -157,46 +125,69 @@ public:
 	TemplateVector(const int a_size, DATA_TYPE const & a_defaultValue)
 	{
 		init();
-		NEWMEM_SOURCE_TRACE(TemplateArray<DATA_TYPE>::ensureCapacity(a_size));
+		NEWMEM_SOURCE_TRACE(ensureCapacity(a_size));
 		for(int i = 0; i < a_size; ++i)
 			add(a_defaultValue);
 	}
 
+	/** @return the size of the list */
+	inline const int & size() const
+	{
+		return this->m_allocated;
+	}
+
 	/** @return the last value in the list */
 	inline DATA_TYPE & getLast()
 	{
-		return this->m_data[m_size-1];
+		return this->m_data[this->m_allocated-1];
 	}
 
 	/** @return the last added value in the list, and lose that value */
-	inline DATA_TYPE & pop()
+	inline DATA_TYPE pop()
 	{
-		return this->m_data[--m_size];
+		DATA_TYPE * last = this->m_data+(--this->m_allocated);
+#ifdef CPP11_HAS_MOVE_SEMANTICS
+		DATA_TYPE value(std::move(*last));
+#else
+		DATA_TYPE value(*last);
+#endif
+		last->~DATA_TYPE();
+		return value;
 	}
 
-	/**
+	/** 
 	 * @param value to add to the list 
 	 * @note adding a value may cause memory allocation
 	 */
 	void add(DATA_TYPE const & a_value)
 	{
-		// where am i storing these values?
-		// if i don't have a place to store them, i better make one.
-		if(this->m_data == 0)
-		{
-			// make a new list to store numbers in
-			NEWMEM_SOURCE_TRACE(TemplateArray<DATA_TYPE>::allocateToSize(this->DEFAULT_ALLOCATION_SIZE));
-		}
-		// if we don't have enough memory allocated for this list
-		if(m_size >= this->m_allocated)
-		{
-			// make a bigger list
-			NEWMEM_SOURCE_TRACE(TemplateArray<DATA_TYPE>::allocateToSize(this->m_allocated*2));
-		}
-		TemplateArray<DATA_TYPE>::set(m_size++, a_value);
+		TemplateArray<DATA_TYPE>::add(a_value);
 	}
 
-	/**
+#if defined(CPP11_HAS_MOVE_SEMANTICS) && defined(CPP11_HAS_VARIADIC_TEMPLATES)
+	/** 
+	 * constructs a new element at the end of the list in place
+	 * @param a_args passed to the DATA_TYPE constructor
+	 * @return the new element, 0 if memory could not be allocated
+	 * @note adding a value may cause memory allocation
+	 */
+	template<typename... ARGS>
+	DATA_TYPE * emplace(ARGS &&... a_args)
+	{
+		return TemplateArray<DATA_TYPE>::emplace(std::forward<ARGS>(a_args)...);
+	}
+
+	/** 
+	 * @param value to move into the end of the list
+	 * @note adding a value may cause memory allocation
+	 */
+	void add(DATA_TYPE && a_value)
+	{
+		emplace(std::move(a_value));
+	}
+#endif
+
+	/** 
 	 * @param a_value to add to the list if it isnt in the list already
 	 * @return the index where the element exists
 	 */
@@ -205,7 +196,7 @@ public:
 		int index = indexOf(a_value);
 		if(index < 0)
 		{
-			index = m_size;
+			index = size();
 			add(a_value);
 		}
 		return index;
@@ -216,35 +207,50 @@ public:
 	{
 		for(int i = 0; i < a_vector.size(); ++i)
 		{
-			NEWMEM_SOURCE_TRACE(add(a_vector.get(i)));
+			NEWMEM_SOURCE_TRACE(add(a_vector.getCONSTREF(i)));
 		}
 	}
 
 	/** @return the number of bytes allocated (likely larger than size()) */
 	inline const int & allocatedCapacity() const {
-		return this->m_allocated;
+		return this->m_capacity;
 	}
 
 	/** 
 	 * @param size the user wants the vector to be (chopping off elements)
 	 * @return false if could not allocate memory
-	 * @note may cause memory allocation if size is bigger than current
+	 * @note may cause memory allocation if size is bigger than current.
+	 * new elements are default-constructed, chopped elements are destroyed.
 	 */
 	inline bool setSize(const int a_size)
 	{
-		bool allocated = false;
-		NEWMEM_SOURCE_TRACE(allocated = TemplateArray<DATA_TYPE>::ensureCapacity(a_size));
-		if(!allocated)
-			return false;
-		m_size = a_size;
+		if(a_size < this->m_allocated)
+		{
+			TemplateArray<DATA_TYPE>::destroyElements(this->m_data+a_size, this->m_allocated-a_size);
+		}
+		else if(a_size > this->m_allocated)
+		{
+			bool allocated = false;
+			NEWMEM_SOURCE_TRACE(allocated = ensureCapacity(a_size));
+			if(!allocated)
+				return false;
+			TemplateArray<DATA_TYPE>::constructElements(this->m_data+this->m_allocated, a_size-this->m_allocated);
+		}
+		this->m_allocated = a_size;
 		return true;
 	}
 
 	/** adds the given array */
 	void add(DATA_TYPE * const & a_list, const int a_numElements){
-		NEWMEM_SOURCE_TRACE(TemplateArray<DATA_TYPE>::ensureCapacity(a_numElements));
+		// a_list may be part of this list, which moves when it grows
+		const int offset = (a_numElements > 0 && this->isElement(a_list[0])) ? (int)(a_list - this->m_data) : -1;
+		bool allocated = false;
+		NEWMEM_SOURCE_TRACE(allocated = ensureCapacity(size()+a_numElements));
+		if(!allocated)
+			return;
+		DATA_TYPE * source = (offset >= 0) ? this->m_data+offset : a_list;
 		for(int i = 0; i < a_numElements; ++i){
-			add(a_list[i]);
+			add(source[i]);
 		}
 	}
 
@@ -260,9 +266,13 @@ public:
 	 */
 	DATA_TYPE remove(const int a_index)
 	{
+#ifdef CPP11_HAS_MOVE_SEMANTICS
+		DATA_TYPE data(std::move(TemplateArray<DATA_TYPE>::get(a_index)));
+#else
 		DATA_TYPE data = TemplateArray<DATA_TYPE>::get(a_index);
-		TemplateArray<DATA_TYPE>::moveDown(a_index, -1, m_size);
-		setSize(m_size-1);
+#endif
+		TemplateArray<DATA_TYPE>::moveDown(a_index, -1, size());
+		setSize(size()-1);
 		return data;
 	}
 
@@ -271,9 +281,7 @@ public:
 	 */
 	void insert(const int a_index, DATA_TYPE const & a_value)
 	{
-		NEWMEM_SOURCE_TRACE(setSize(m_size+1));
-		TemplateArray<DATA_TYPE>::moveUp(a_index, 1, m_size);
-		this->set(a_index, a_value);
+		TemplateArray<DATA_TYPE>::insert(a_index, a_value);
 	}
 
 	/** 
@@ -282,57 +290,41 @@ public:
 	 */
 	inline const DATA_TYPE pull()
 	{
-		DATA_TYPE value = TemplateArray<DATA_TYPE>::get(0);
-		remove(0);
-		return value;
+		return remove(0);
 	}
 
-	/**
+	/** 
 	 * a remove function that does not maintain proper list order
 	 * @param a_index is replaced by the last element, then size is reduced.
 	 */
 	inline void removeFast(const int a_index)
 	{
-		TemplateArray<DATA_TYPE>::swap(a_index, m_size-1);
-		this->setSize(m_size-1);
+		TemplateArray<DATA_TYPE>::swap(a_index, size()-1);
+		this->setSize(size()-1);
 	}
 
-	/**
+	/** 
 	 * @param removes all elements of this value in one O(N) process 
 	 * @return number of elements removed
 	 */
 	int removeAll(DATA_TYPE const & a_value)
 	{
-		int removed = 0;
-		for(int i = 0; i < m_size-removed; ++i)
-		{
-			while(i+removed < m_size
-			&& TemplateArray<DATA_TYPE>::get(i+removed) == a_value){
-				++removed;
-			}
-			if(removed > 0){
-				this->set(i, TemplateArray<DATA_TYPE>::get(i+removed));
-			}
-		}
-		setSize(m_size-removed);
+		const int kept = TemplateScan::removeAll(this->m_data, size(), a_value);
+		const int removed = size()-kept;
+		setSize(kept);
 		return removed;
 	}
 
 	/** @return the index of the first appearance of a_value in this vector. uses == */
 	inline int indexOf(DATA_TYPE const & a_value) const
 	{
-		for(int i = 0; i < m_size; ++i)
-		{
-			if(this->getCONST(i) == a_value)
-				return i;
-		}
-		return -1;
+		return TemplateScan::indexOf(this->m_data, 0, size(), a_value);
 	}
 
 	/** @return index of 1st a_value at or after a_startingIndex. uses == */
 	inline int indexOf(DATA_TYPE const & a_value, const int a_startingIndex) const
 	{
-		return TemplateArray<DATA_TYPE>::indexOf(a_value, a_startingIndex, m_size);
+		return TemplateArray<DATA_TYPE>::indexOf(a_value, a_startingIndex, size());
 	}
 
 	/** @return index of 1st a_value at or after a_startingIndex. uses == */
@@ -341,56 +333,131 @@ public:
 		return TemplateArray<DATA_TYPE>::indexOf(a_value, a_startingIndex, a_size);
 	}
 
-	/**
+	/** 
 	 * will only work correctly if the TemplateVector is sorted.
 	 * @return the index of the given value, -1 if the value is not in the list
 	 */
 	inline int indexOfWithBinarySearch(DATA_TYPE const & a_value) const
 	{
-		if(m_size)
+		if(size())
 		{
-			return TemplateArray<DATA_TYPE>::indexOfWithBinarySearch(a_value, 0, m_size);
+			return TemplateArray<DATA_TYPE>::indexOfWithBinarySearch(a_value, 0, size());
 		}
 		return -1;    // failed to find key
 	}
 
-	/**
+	/** 
 	 * uses binary sort to put values in the correct index. safe if soring is always used
 	 * @param a_value value to insert in order
 	 * @param a_allowDuplicates will not insert duplicates if set to false
-	 * @return the index where a_value was inserted
+	 * @return the index where a_value was inserted (or where its duplicate is)
 	 */
 	int insertSorted(DATA_TYPE const & a_value, const bool a_allowDuplicates)
 	{
-		int index = -1;
-		if(!m_size || a_value < TemplateArray<DATA_TYPE>::get(0))
+		// after any equal elements, so equal values stay in insertion order
+		int index = TemplateArray<DATA_TYPE>::upperBound(a_value, 0, size());
+		if(!a_allowDuplicates)
 		{
-			index = 0;
+			// check every element that sorts equal to a_value
+			for(int i = index-1; i >= 0 && !(this->m_data[i] < a_value); --i)
+			{
+				if(a_value == this->m_data[i])
+					return i;
+			}
 		}
-		else if(!(a_value < TemplateArray<DATA_TYPE>::get(m_size-1)))
+		NEWMEM_SOURCE_TRACE(insert(index, a_value));
+		return index;
+	}
+
+#ifdef CPP11_HAS_MOVE_SEMANTICS
+#define TEMPLATEVECTOR_MOVE(value)	std::move(value)
+#else
+#define TEMPLATEVECTOR_MOVE(value)	(value)
+#endif
+	/**
+	 * inserts many values in order, in one O(N+K*log(K)) pass, instead of K
+	 * O(N) insertSorted calls. this vector must already be sorted.
+	 * @param a_values values to insert, sorted or not
+	 * @param a_count how many values are in a_values
+	 * @param a_allowDuplicates will not insert duplicates (of values already
+	 * in this vector, or in a_values) if set to false
+	 * @return how many values were inserted, 0 if memory could not be allocated
+	 */
+	int insertSortedBulk(DATA_TYPE const * a_values, const int a_count, const bool a_allowDuplicates)
+	{
+		if(a_count <= 0)
+			return 0;
+		// sorted copy of the batch. stable, so equal values keep their order
+		TemplateVector<DATA_TYPE> batch;
+		bool allocated = false;
+		NEWMEM_SOURCE_TRACE(allocated = batch.ensureCapacity(a_count));
+		if(!allocated)
+			return 0;
+		for(int i = 0; i < a_count; ++i)
 		{
-			index = m_size;
+			batch.add(a_values[i]);
 		}
-		else
+		batch.sortStable();
+		DATA_TYPE * in = batch.m_data;
+		int inCount = a_count;
+		const int count = size();
+		if(!a_allowDuplicates)
 		{
-			int first = 0, last = m_size;
-			while (first <= last)
+			// drop values already in the batch or in this vector, in one pass
+			int kept = 0, existing = 0;
+			for(int i = 0; i < inCount; ++i)
 			{
-				index = (first + last) / 2;
-				if (!(a_value < this->m_data[index]))
-					first = index + 1;
-				else if (a_value < this->m_data[index])
-					last = index - 1;
+				// compare with each value that sorts equal, in the batch and this vector
+				bool found = false;
+				for(int e = kept-1; !found && e >= 0 && !(in[e] < in[i]); --e)
+				{
+					found = (in[i] == in[e]);
+				}
+				while(existing < count && this->m_data[existing] < in[i])
+					++existing;
+				for(int e = existing; !found && e < count && !(in[i] < this->m_data[e]); ++e)
+				{
+					found = (in[i] == this->m_data[e]);
+				}
+				if(found)
+					continue;
+				if(kept != i)
+					in[kept] = TEMPLATEVECTOR_MOVE(in[i]);
+				++kept;
 			}
-			if(!(a_value < this->m_data[index]))
-				index++;
+			inCount = kept;
 		}
-		if(!m_size  || a_allowDuplicates || a_value != this->m_data[index])
-			NEWMEM_SOURCE_TRACE(insert(index, a_value));
-		return index;
+		if(!inCount)
+			return 0;
+		NEWMEM_SOURCE_TRACE(allocated = ensureCapacity(count+inCount));
+		if(!allocated)
+			return 0;
+		// merge from the back, so each element moves once. slots past the old
+		// end are raw memory, and get constructed instead of assigned
+		DATA_TYPE * data = this->m_data;
+		int i = count-1, j = inCount-1, w = count+inCount-1;
+		while(j >= 0)
+		{
+			// batch values go after equal values already in the vector
+			DATA_TYPE & next = (i >= 0 && in[j] < data[i]) ? data[i--] : in[j--];
+			if(w >= count)
+				new (&data[w]) DATA_TYPE(TEMPLATEVECTOR_MOVE(next));
+			else
+				data[w] = TEMPLATEVECTOR_MOVE(next);
+			--w;
+		}
+		this->m_allocated = count+inCount;
+		return inCount;
 	}
+#undef TEMPLATEVECTOR_MOVE
 
-	/**
+	/** @see insertSortedBulk(DATA_TYPE const *, const int, const bool) */
+	inline int insertSortedBulk(TemplateArray<DATA_TYPE> const & a_values, const bool a_allowDuplicates)
+	{
+		return insertSortedBulk(a_values.getRawListConst(), a_values.size(), a_allowDuplicates);
+	}
+
+	/** 
 	 * a remove function that does not maintain proper list order
 	 * @param a_value first appearance replaced by last element. breaks if not in list
 	 */
@@ -399,7 +466,7 @@ public:
 		removeFast(indexOf(a_value));
 	}
 
-	/**
+	/** 
 	 * @param a_listToExclude removes these elements from *this list
 	 * @return true if at least one element was removed
 	 */
@@ -410,7 +477,7 @@ public:
 		{
 			for(int i = 0; i < size(); ++i)
 			{
-				if(a_listToExclude.get(e) == TemplateArray<DATA_TYPE>::get(i))
+				if(a_listToExclude.getCONSTREF(e) == TemplateArray<DATA_TYPE>::get(i))
 				{
 					removeFast(i);
 					--i;
@@ -433,13 +500,47 @@ public:
 		release();
 	}
 
+	/** sorts the vector using operator<. numbers are radix sorted */
 	void sort(){
-		TemplateArray<DATA_TYPE>::sort(0, m_size);
+		TemplateArray<DATA_TYPE>::sort(0, size());
+	}
+
+	/** sorts the vector using operator<, keeping equal elements in order */
+	void sortStable(){
+		TemplateArray<DATA_TYPE>::sortStable(0, size());
+	}
+
+	/** @param aBeforeB called as aBeforeB(a, b), true if a should come before b */
+	template<typename LESS>
+	void sortFunction(LESS aBeforeB){
+		TemplateArray<DATA_TYPE>::sortFunction(0, size(), aBeforeB);
+	}
+
+	/** @param aBeforeB called as aBeforeB(a, b), true if a should come before b */
+	template<typename LESS>
+	void sortStableFunction(LESS aBeforeB){
+		TemplateArray<DATA_TYPE>::sortStableFunction(0, size(), aBeforeB);
+	}
+
+#ifdef CPP11_HAS_THREADS
+	/**
+	 * sorts the vector using operator< on multiple threads
+	 * @param a_threadCount how many threads to use. 0 uses one per core.
+	 * small vectors are sorted on this thread.
+	 */
+	void sortParallel(const int a_threadCount = 0){
+		TemplateArray<DATA_TYPE>::sortParallel(0, size(), a_threadCount);
+	}
+
+	/** like sortParallel, keeping equal elements in order */
+	void sortStableParallel(const int a_threadCount = 0){
+		TemplateArray<DATA_TYPE>::sortStableParallel(0, size(), a_threadCount);
 	}
 
-#ifdef CPP11_HAS_LAMBDA_SEMANTICS
-	void sortFunction(std::function<bool(DATA_TYPE &, DATA_TYPE &)> aBeforeB){
-		TemplateArray<DATA_TYPE>::sortFunction(0, m_size,aBeforeB);
+	/** like sortFunction, on a_threadCount threads (0 uses one per core) */
+	template<typename LESS>
+	void sortFunctionParallel(LESS aBeforeB, const int a_threadCount = 0){
+		TemplateArray<DATA_TYPE>::sortFunctionParallel(0, size(), aBeforeB, a_threadCount);
 	}
 #endif
-};
+};
\ No newline at end of file
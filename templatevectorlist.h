@@ -3,6 +3,9 @@
 #include "license.txt"
 #include "templatevector.h"
 
+#include <iterator>	// std::random_access_iterator_tag
+#include <stddef.h>	// ptrdiff_t
+
 /**
  * a Vector that grows in a way that is memory stable.
  * this data structure is ideal when a vector of elements is needed,
@@ -61,8 +64,73 @@ public:
 		int subIndex = a_index % m_allocationSize;
 		return m_allocations.getCONST(arrIndex)[subIndex];
 	}
+	DATA_TYPE const & getCONSTREF(int const & a_index) const {
+		int arrIndex = a_index / m_allocationSize;
+		int subIndex = a_index % m_allocationSize;
+		return m_allocations.getCONST(arrIndex)[subIndex];
+	}
 	inline DATA_TYPE & operator[](int const a_index){return get(a_index);}
 
+	/**
+	 * random access iterator over the pages of the list. VALUE is DATA_TYPE
+	 * or const DATA_TYPE. adding elements can invalidate it.
+	 */
+	template<typename VALUE>
+	class IteratorBase
+	{
+		DATA_TYPE * const * m_pages;
+		int m_pageSize, m_index;
+	public:
+		typedef std::random_access_iterator_tag iterator_category;
+		typedef DATA_TYPE value_type;
+		typedef ptrdiff_t difference_type;
+		typedef VALUE * pointer;
+		typedef VALUE & reference;
+
+		IteratorBase():m_pages(0),m_pageSize(1),m_index(0){}
+		IteratorBase(DATA_TYPE * const * a_pages, const int a_pageSize, const int a_index)
+			:m_pages(a_pages),m_pageSize(a_pageSize),m_index(a_index){}
+		/** allows iterator to become const_iterator */
+		template<typename OTHER>
+		IteratorBase(IteratorBase<OTHER> const & a_other)
+			:m_pages(a_other.pages()),m_pageSize(a_other.pageSize()),m_index(a_other.index()){}
+
+		DATA_TYPE * const * pages() const { return m_pages; }
+		int pageSize() const { return m_pageSize; }
+		/** @return the index in the TemplateVectorList this iterator is at */
+		int index() const { return m_index; }
+
+		reference operator*() const { return m_pages[m_index / m_pageSize][m_index % m_pageSize]; }
+		pointer operator->() const { return &operator*(); }
+		reference operator[](const difference_type a_offset) const { return *(*this + a_offset); }
+
+		IteratorBase & operator++() { ++m_index; return *this; }
+		IteratorBase & operator--() { --m_index; return *this; }
+		IteratorBase operator++(int) { IteratorBase old(*this); ++m_index; return old; }
+		IteratorBase operator--(int) { IteratorBase old(*this); --m_index; return old; }
+		IteratorBase & operator+=(const difference_type a_offset) { m_index += (int)a_offset; return *this; }
+		IteratorBase & operator-=(const difference_type a_offset) { m_index -= (int)a_offset; return *this; }
+		IteratorBase operator+(const difference_type a_offset) const { return IteratorBase(m_pages, m_pageSize, m_index+(int)a_offset); }
+		IteratorBase operator-(const difference_type a_offset) const { return IteratorBase(m_pages, m_pageSize, m_index-(int)a_offset); }
+		friend IteratorBase operator+(const difference_type a_offset, IteratorBase const & a_iter) { return a_iter + a_offset; }
+		difference_type operator-(IteratorBase const & a_other) const { return m_index - a_other.m_index; }
+
+		bool operator==(IteratorBase const & a_other) const { return m_index == a_other.m_index; }
+		bool operator!=(IteratorBase const & a_other) const { return m_index != a_other.m_index; }
+		bool operator<(IteratorBase const & a_other) const { return m_index < a_other.m_index; }
+		bool operator>(IteratorBase const & a_other) const { return m_index > a_other.m_index; }
+		bool operator<=(IteratorBase const & a_other) const { return m_index <= a_other.m_index; }
+		bool operator>=(IteratorBase const & a_other) const { return m_index >= a_other.m_index; }
+	};
+	typedef IteratorBase<DATA_TYPE> iterator;
+	typedef IteratorBase<const DATA_TYPE> const_iterator;
+	typedef DATA_TYPE value_type;
+
+	iterator begin() { return iterator(m_allocations.getRawList(), m_allocationSize, 0); }
+	iterator end() { return iterator(m_allocations.getRawList(), m_allocationSize, m_size); }
+	const_iterator begin() const { return const_iterator(m_allocations.getRawListConst(), m_allocationSize, 0); }
+	const_iterator end() const { return const_iterator(m_allocations.getRawListConst(), m_allocationSize, m_size); }
+
 	DATA_TYPE & getLast()
 	{
 		return get(m_size-1);
@@ -198,20 +266,32 @@ public:
 	}
 #endif
 
-#ifdef CPP11_HAS_LAMBDA_SEMANTICS
-	/** @param f execute this code for each element of this container */
-	void for_each_full(std::function<void (DATA_TYPE & value, const int index)> f){
-		for(int i = 0; i < size(); ++i)
-			f(TemplateVectorList<DATA_TYPE>::get(i), i);
-	}
-	/** @param f execute this code for each element of this container */
-	void for_each(std::function<void (DATA_TYPE & value)> f){
-		for(int i = 0; i < size(); ++i)
+	/** @param f called as f(value, index) for each element, a page at a time */
+	template<typename FUNCTION>
+	void for_each_full(FUNCTION f){
+		int index = 0;
+		for(int p = 0; index < m_size; ++p)
 		{
-			f(TemplateVectorList<DATA_TYPE>::get(i));
+			DATA_TYPE * page = m_allocations.get(p);
+			const int count = (m_size-index < m_allocationSize) ? (m_size-index) : m_allocationSize;
+			for(int i = 0; i < count; ++i)
+				f(page[i], index+i);
+			index += count;
+		}
+	}
+	/** @param f called as f(value) for each element, a page at a time */
+	template<typename FUNCTION>
+	void for_each(FUNCTION f){
+		int index = 0;
+		for(int p = 0; index < m_size; ++p)
+		{
+			DATA_TYPE * page = m_allocations.get(p);
+			const int count = (m_size-index < m_allocationSize) ? (m_size-index) : m_allocationSize;
+			for(int i = 0; i < count; ++i)
+				f(page[i]);
+			index += count;
 		}
 	}
-#endif
 
 #ifdef CPP11_HAS_INITIALIZER_LIST
 	TemplateVectorList( const std::initializer_list <DATA_TYPE> & ilist )
@@ -190,8 +190,8 @@ public:
 		v.setRadians(a_piRadians);
 		return v;
 	}
-	/** copy constructor */
-	V(const V<BASE, T> & v){set(v);}
+	// the implicit copy constructor is used, so V stays trivially copyable,
+	// and a TemplateVector<V2I> (or any other V) can relocate its elements with memcpy
 
 	/**
 	 * declares a "global" variable in a function, which is OK in a template!
@@ -91,8 +91,8 @@ public:
 	V2(VTYPE * a_twoValues):x(a_twoValues[0]),y(a_twoValues[1]){}
 	/** turns a pi-radians angle into a vector */
 	explicit V2(VTYPE a_piRadians):x(V_COS(a_piRadians)), y(V_SIN(a_piRadians)){}
-	/** copy constructor */
-	V2(const V2<VTYPE> & v):x(v.x),y(v.y){}
+	// the implicit copy constructor is used, so V2 stays trivially copyable,
+	// and a TemplateVector<V2F> can relocate its elements with memcpy
 
 	/** sets x and y to zero */
 	inline void zero(){x=y=0;}